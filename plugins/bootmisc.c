@@ -21,9 +21,16 @@
  * THE SOFTWARE.
  */
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <ftw.h>
+#include <glob.h>
 #include <mntent.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 #else
@@ -31,9 +38,11 @@
 #endif
 
 #include "config.h"
+#include "cgroup.h"
 #include "finit.h"
 #include "helpers.h"
 #include "plugin.h"
+#include "sig.h"
 #include "util.h"
 #include "utmp-api.h"
 
@@ -80,12 +89,199 @@ static int bootclean(const char *fpath, const struct stat *sb, int tflag, struct
 	return 0;
 }
 
+#ifdef DEFERRED_CLEAN
+#define STALE_MAX          16
+
+#ifndef IOPRIO_CLASS_IDLE
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+static char *stale[STALE_MAX];
+static int   num_stale;
+
+/*
+ * Only root owned directories, created by us at boot, are removed.
+ * Anything else matching our pattern could be planted by a user.
+ */
+static void stale_add(const char *path)
+{
+	struct stat st;
+
+	if (num_stale >= STALE_MAX)
+		return;
+
+	if (lstat(path, &st) || !S_ISDIR(st.st_mode) || st.st_uid != 0)
+		return;
+
+	stale[num_stale] = strdup(path);
+	if (stale[num_stale])
+		num_stale++;
+}
+
+/*
+ * A mount point cannot be renamed, so instead move everything in it
+ * to a private subdirectory, including leftovers from last boot.
+ */
+static int empty(const char *dir, char *old, size_t len)
+{
+	struct dirent *d;
+	char *name;
+	DIR *dp;
+	int n, fd;
+
+	for (n = 0; n < 100; n++) {
+		snprintf(old, len, "%s/.stale.%d", dir, n);
+		if (!mkdir(old, 0700))
+			break;
+		if (errno != EEXIST)
+			return 1;
+	}
+	if (n == 100)
+		return 1;
+
+	fd = open(old, O_RDONLY | O_DIRECTORY);
+	if (fd == -1)
+		return 1;
+
+	dp = opendir(dir);
+	if (!dp) {
+		close(fd);
+		return 1;
+	}
+
+	name = strrchr(old, '/') + 1;
+	while ((d = readdir(dp))) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..") || !strcmp(d->d_name, name))
+			continue;
+
+		if (renameat(dirfd(dp), d->d_name, fd, d->d_name))
+			_pe("Failed moving %s/%s aside", dir, d->d_name);
+	}
+
+	closedir(dp);
+	close(fd);
+
+	return 0;
+}
+
+/*
+ * Move a stale directory aside and recreate it empty, with the same
+ * owner and mode.  The old tree is removed in the background when the
+ * system is up, see purge().
+ */
+static int aside(const char *path)
+{
+	char dir[PATH_MAX], old[PATH_MAX + 16];
+	struct stat st;
+	int moved = 0;
+	glob_t gl;
+	size_t i;
+	int n;
+
+	if (!realpath(path, dir) || stat(dir, &st))
+		return 1;
+
+	for (n = 0; n < 100; n++) {
+		snprintf(old, sizeof(old), "%s.stale.%d", dir, n);
+		if (!rename(dir, old)) {
+			moved = 1;
+			break;
+		}
+		if (errno != EEXIST && errno != ENOTEMPTY)
+			break;
+	}
+
+	if (moved) {
+		chmod(old, 0700);
+		if (mkdir(dir, 0700) || chown(dir, st.st_uid, st.st_gid) ||
+		    chmod(dir, st.st_mode & 07777)) {
+			_pe("Failed recreating %s", dir);
+			return 1;
+		}
+		if (whichp("restorecon"))
+			run(str("restorecon %s", dir));
+	} else if (empty(dir, old, sizeof(old)))
+		return 1;
+
+	_d("Moved %s aside to %s", dir, old);
+	stale_add(old);
+
+	/* Leftovers from an interrupted cleanup last boot */
+	snprintf(old, sizeof(old), "%s.stale.*", dir);
+	if (!glob(old, 0, NULL, &gl)) {
+		for (i = 0; i < gl.gl_pathc; i++) {
+			int dup = 0;
+
+			for (n = 0; n < num_stale; n++) {
+				if (!strcmp(stale[n], gl.gl_pathv[i]))
+					dup = 1;
+			}
+			if (!dup)
+				stale_add(gl.gl_pathv[i]);
+		}
+		globfree(&gl);
+	}
+
+	return 0;
+}
+
+static int purgeclean(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+{
+	(void)remove(fpath);
+
+	return 0;
+}
+
+/*
+ * Remove trees moved aside at boot.  Runs at the lowest CPU and I/O
+ * priority in a cgroup of its own, not to compete with services.
+ */
+static void purge(void *arg)
+{
+	struct cgroup cg = {
+		.cfg = "cpu.weight:1",
+	};
+	pid_t pid;
+	int i;
+
+	if (!num_stale)
+		return;
+
+	pid = fork();
+	switch (pid) {
+	case -1:
+		_pe("Failed forking cleanup of stale files");
+		return;
+	case 0:
+		sig_unblock();
+		setsid();
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+		setpriority(PRIO_PROCESS, 0, 19);
+
+		for (i = 0; i < num_stale; i++)
+			nftw(stale[i], purgeclean, 20, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+		_exit(0);
+	default:
+		cgroup_service("bootclean", pid, &cg);
+		break;
+	}
+
+	for (i = 0; i < num_stale; i++)
+		free(stale[i]);
+	num_stale = 0;
+}
+#endif /* DEFERRED_CLEAN */
+
 /*
  * Cleanup stale files from previous boot, if any still linger on.
  * Some systems, e.g. Alpine Linux, still have a persistent /run and
  * /tmp, i.e. not tmpfs.
  *
- * We can safely skip tmpfs, nothing to clean there.
+ * We can safely skip tmpfs, nothing to clean there.  With deferred
+ * cleanup the directories are only moved aside here, which is cheap
+ * regardless of the number of files, and removed after boot.
  */
 static void clean(void *arg)
 {
@@ -100,6 +296,10 @@ static void clean(void *arg)
 		if (is_tmpfs(dir[i]))
 			continue;
 
+#ifdef DEFERRED_CLEAN
+		if (!aside(dir[i]))
+			continue;
+#endif
 		nftw(dir[i], bootclean, 20, FTW_DEPTH);
 	}
 }
@@ -207,6 +407,9 @@ static plugin_t plugin = {
 	.name = __FILE__,
 	.hook[HOOK_MOUNT_POST] = { .cb = clean },
 	.hook[HOOK_BASEFS_UP]  = { .cb = setup },
+#ifdef DEFERRED_CLEAN
+	.hook[HOOK_SYSTEM_UP]  = { .cb = purge },
+#endif
 	.depends = { "pidfile" },
 };
 
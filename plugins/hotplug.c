@@ -20,14 +20,369 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <glob.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 
 #include "config.h"
 #include "conf.h"
+#include "cond.h"
 #include "finit.h"
 #include "helpers.h"
+#include "log.h"
+#include "loop.h"
 #include "plugin.h"
 #include "service.h"
+#include "util.h"
+
+#define COLDPLUG_COND      COND_DEV "coldplug/done"
+#define COLDPLUG_RUN       "run/coldplug/done"	/* udevadm fallback */
+#define COLDPLUG_INFLIGHT  64		/* Max events queued in udevd */
+#define COLDPLUG_POLL      100		/* msec, waiting for udevd */
+#define COLDPLUG_IDLE      5000		/* msec without progress from udevd */
+
+#define UDEV_GROUP         2		/* Events processed by udevd */
+#define UDEV_MAGIC         0xfeedcafe
+
+/* Head of libudev monitor messages, in host byte order except magic */
+struct udev_hdr {
+	char         prefix[8];
+	unsigned int magic;
+	unsigned int header_size;
+	unsigned int properties_off;
+	unsigned int properties_len;
+};
+
+static char  **uevents;
+static size_t  num, max, next;
+static int     inflight;
+static size_t  pending[COLDPLUG_INFLIGHT];	/* uevents[] index + 1, 0: free */
+static int     waiting;
+static int     fallback;
+
+static uint64_t start;
+static uev_t    nlw, tmr;
+
+/*
+ * Collect uevent files, parents sort before their children since an
+ * event for a child device may otherwise be handled before its parent.
+ */
+static int add(const char *path)
+{
+	if (num == max) {
+		char **tmp;
+
+		tmp = realloc(uevents, (max + 256) * sizeof(char *));
+		if (!tmp)
+			return 1;
+		uevents = tmp;
+		max += 256;
+	}
+
+	uevents[num] = strdup(path);
+	if (!uevents[num])
+		return 1;
+	num++;
+
+	return 0;
+}
+
+/*
+ * Like udevadm, skip kobjects without a subsystem, e.g. platform and
+ * cpu cache entries.  The kernel emits no event for them, so we would
+ * wait in vain for udevd to report them processed.
+ */
+static int collect(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+{
+	char path[PATH_MAX];
+
+	if (tflag != FTW_F || strcmp(&fpath[ftw->base], "uevent"))
+		return 0;
+
+	snprintf(path, sizeof(path), "%.*ssubsystem", ftw->base, fpath);
+	if (access(path, F_OK))
+		return 0;
+
+	return add(fpath);
+}
+
+static int depth(const char *path)
+{
+	int n = 0;
+
+	while ((path = strchr(path, '/'))) {
+		path++;
+		n++;
+	}
+
+	return n;
+}
+
+static int compare(const void *a, const void *b)
+{
+	const char *pa = *(const char **)a, *pb = *(const char **)b;
+	int da = depth(pa), db = depth(pb);
+
+	if (da != db)
+		return da - db;
+
+	return strcmp(pa, pb);
+}
+
+/*
+ * Same as `udevadm trigger -c add -t devices` followed by subsystems,
+ * but in one pass over /sys.  Devices are found in /sys/devices, all
+ * other device links in /sys point there.
+ */
+static void scan(void)
+{
+	char *subsys[] = {
+		"/sys/bus/*/uevent",
+		"/sys/bus/*/drivers/*/uevent",
+		"/sys/module/*/uevent",
+		NULL
+	};
+	size_t devs;
+	glob_t gl;
+	int i;
+
+	nftw("/sys/devices", collect, 20, FTW_PHYS);
+	devs = num;
+	qsort(uevents, devs, sizeof(char *), compare);
+
+	for (i = 0; subsys[i]; i++) {
+		size_t j;
+
+		if (glob(subsys[i], 0, NULL, &gl))
+			continue;
+
+		for (j = 0; j < gl.gl_pathc; j++)
+			add(gl.gl_pathv[j]);
+		globfree(&gl);
+	}
+
+	_d("Found %zu devices and %zu subsystems", devs, num - devs);
+}
+
+/* Give up on all events triggered but not reported by udevd */
+static void forget(void)
+{
+	memset(pending, 0, sizeof(pending));
+	inflight = 0;
+}
+
+static void done(void)
+{
+	size_t i;
+
+	uev_io_stop(&nlw);
+	close(nlw.fd);
+	uev_timer_stop(&tmr);
+
+	for (i = 0; i < num; i++)
+		free(uevents[i]);
+	free(uevents);
+	uevents = NULL;
+	num = max = next = 0;
+
+	logit(LOG_INFO, "Coldplug done in %llu ms", (unsigned long long)(mono_usec() - start) / 1000);
+	cond_set_oneshot(COLDPLUG_COND);
+}
+
+/*
+ * Keep at most COLDPLUG_INFLIGHT events queued in udevd, the rest are
+ * triggered as udevd reports them processed.
+ */
+static void trigger(void)
+{
+	while (inflight < COLDPLUG_INFLIGHT && next < num) {
+		size_t i;
+		int fd;
+
+		fd = open(uevents[next++], O_WRONLY | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+
+		if (write(fd, "add", 3) == 3) {
+			for (i = 0; pending[i]; i++)
+				;
+			pending[i] = next;
+			inflight++;
+		}
+		close(fd);
+	}
+
+	if (next == num && !inflight)
+		done();
+}
+
+/* Is /sys/@devpath/uevent the file at @path? */
+static int same(const char *path, const char *devpath)
+{
+	size_t len = strlen(devpath);
+
+	return !strncmp(path, "/sys", 4) && !strncmp(&path[4], devpath, len) &&
+		!strcmp(&path[4 + len], "/uevent");
+}
+
+/*
+ * Match a processed "add" event from udevd, by its DEVPATH, with one
+ * we have triggered.  Other events, e.g., for devices plugged in
+ * meanwhile, are ignored.
+ */
+static int processed(char *buf, size_t len)
+{
+	struct udev_hdr *hdr = (struct udev_hdr *)buf;
+	char *devpath = NULL;
+	size_t off, end, i;
+	int add = 0;
+
+	if (len < sizeof(*hdr) || strcmp(hdr->prefix, "libudev") || ntohl(hdr->magic) != UDEV_MAGIC)
+		return 0;
+
+	off = hdr->properties_off;
+	end = off + hdr->properties_len;
+	if (end > len)
+		return 0;
+
+	while (off < end) {
+		if (!strcmp(&buf[off], "ACTION=add"))
+			add = 1;
+		else if (!strncmp(&buf[off], "DEVPATH=", 8))
+			devpath = &buf[off + 8];
+		off += strlen(&buf[off]) + 1;
+	}
+
+	if (!add || !devpath)
+		return 0;
+
+	for (i = 0; i < NELEMS(pending); i++) {
+		if (!pending[i] || !same(uevents[pending[i] - 1], devpath))
+			continue;
+
+		pending[i] = 0;
+		inflight--;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void nl_cb(uev_t *w, void *arg, int events)
+{
+	char buf[8192];
+	int progress = 0;
+	ssize_t len;
+
+	if (UEV_ERROR == events) {
+		uev_io_start(w);
+		return;
+	}
+
+	while ((len = recv(w->fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = 0;
+		if (processed(buf, len))
+			progress = 1;
+	}
+
+	/* Lost events, the idle timer takes care of it */
+	if (len == -1 && errno == ENOBUFS)
+		_w("Coldplug netlink socket overrun");
+
+	if (!progress)
+		return;
+
+	uev_timer_set(&tmr, COLDPLUG_IDLE, COLDPLUG_IDLE);
+	trigger();
+}
+LOOP_PROBE(nl_cb)
+
+/*
+ * Wait for udevd to come up, then trigger.  Events sent before udevd
+ * listens are lost.  If udevd stops reporting progress we move on.
+ * In fallback mode, wait for the udevadm run jobs to complete.
+ */
+static void tmr_cb(uev_t *w, void *arg, int events)
+{
+	if (UEV_ERROR == events) {
+		uev_timer_start(w);
+		return;
+	}
+
+	if (fallback) {
+		if (cond_get(COLDPLUG_RUN) != COND_ON)
+			return;
+
+		uev_timer_stop(w);
+		logit(LOG_INFO, "Coldplug done, udevadm settled");
+		cond_set_oneshot(COLDPLUG_COND);
+		return;
+	}
+
+	if (waiting) {
+		if (cond_get(COND_PID "udevd") != COND_ON)
+			return;
+
+		waiting = 0;
+		start = mono_usec();
+		scan();
+		uev_timer_set(w, COLDPLUG_IDLE, COLDPLUG_IDLE);
+		trigger();
+		return;
+	}
+
+	if (next == num) {
+		_w("Coldplug timed out, %d events not reported by udevd", inflight);
+		forget();
+		done();
+		return;
+	}
+
+	_w("Coldplug stalled, %d events not reported by udevd, continuing", inflight);
+	forget();
+	trigger();
+}
+LOOP_PROBE(tmr_cb)
+
+static int coldplug(void)
+{
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = UDEV_GROUP,
+	};
+	int sz = 1024 * 1024;
+	int sd;
+
+	sd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (sd == -1) {
+		_pe("Failed opening udev monitor socket");
+		return 1;
+	}
+
+	if (setsockopt(sd, SOL_SOCKET, SO_RCVBUFFORCE, &sz, sizeof(sz)))
+		(void)setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+
+	if (bind(sd, (struct sockaddr *)&sa, sizeof(sa))) {
+		_pe("Failed binding udev monitor socket");
+		close(sd);
+		return 1;
+	}
+
+	waiting = 1;
+	forget();
+	uev_io_init(ctx, &nlw, LOOP_CB(nl_cb), NULL, sd, UEV_READ);
+	uev_timer_init(ctx, &tmr, LOOP_CB(tmr_cb), NULL, COLDPLUG_POLL, COLDPLUG_POLL);
+
+	return 0;
+}
 
 static void setup(void *arg)
 {
@@ -52,42 +407,63 @@ static void setup(void *arg)
 			 "-- Device event managing daemon", path);
 		if (service_register(SVC_TYPE_SERVICE, cmd, global_rlimit, NULL)) {
 			_pe("Failed registering %s", path);
-		} else {
-			snprintf(cmd, sizeof(cmd), "cgroup.init :1 [S] <pid/udevd> log "
-				 "udevadm trigger -c add -t devices "
-				 "-- Requesting device events");
-			service_register(SVC_TYPE_RUN, cmd, global_rlimit, NULL);
-
-			snprintf(cmd, sizeof(cmd), "cgroup.init :2 [S] <pid/udevd> log "
-				 "udevadm trigger -c add -t subsystems "
-				 "-- Requesting subsystem events");
-			service_register(SVC_TYPE_RUN, cmd, global_rlimit, NULL);
+			free(path);
+			goto mdev;
 		}
-
 		free(path);
 
-		/* Debian has this little script to copy generated
-		 * rules while the system was read-only. TODO: When
-		 * this functionality was hardcoded in finit.c, this
-		 * call was made in crank_worker(). Now that
-		 * filesystems are mounted earlier we should be able
-		 * to make this call directly after the triggers have
-		 * run, but this has not been tested AT ALL. */
-		if (fexist("/lib/udev/udev-finish"))
-			run_interactive("/lib/udev/udev-finish", "Finalizing udev");
-	} else {
-		path = which("mdev");
-		if (path) {
-			/* Embedded Linux systems usually have BusyBox mdev */
-			if (debug)
-				touch("/dev/mdev.log");
-
-			snprintf(cmd, sizeof(cmd), "%s -s", path);
-			free(path);
-
-			run_interactive(cmd, "Populating device tree");
+		/*
+		 * Debian has this little script to copy generated
+		 * rules while the system was read-only.  Run it when
+		 * the coldplug events have been processed.
+		 */
+		if (fexist("/lib/udev/udev-finish")) {
+			snprintf(cmd, sizeof(cmd), "cgroup.init [S] <%s> log "
+				 "/lib/udev/udev-finish -- Finalizing udev", COLDPLUG_COND);
+			service_register(SVC_TYPE_TASK, cmd, global_rlimit, NULL);
 		}
+
+		if (!coldplug())
+			return;
+
+		/*
+		 * Fall back to udevadm, coldplug is done when the
+		 * last run job has seen udevd process all events.
+		 */
+		snprintf(cmd, sizeof(cmd), "cgroup.init :1 [S] <pid/udevd> log "
+			 "udevadm trigger -c add -t devices "
+			 "-- Requesting device events");
+		service_register(SVC_TYPE_RUN, cmd, global_rlimit, NULL);
+
+		snprintf(cmd, sizeof(cmd), "cgroup.init :2 [S] <pid/udevd> log "
+			 "udevadm trigger -c add -t subsystems "
+			 "-- Requesting subsystem events");
+		service_register(SVC_TYPE_RUN, cmd, global_rlimit, NULL);
+
+		snprintf(cmd, sizeof(cmd), "cgroup.init name:coldplug [S] <pid/udevd> log "
+			 "udevadm settle -t 60 "
+			 "-- Waiting for device events");
+		service_register(SVC_TYPE_RUN, cmd, global_rlimit, NULL);
+
+		fallback = 1;
+		uev_timer_init(ctx, &tmr, LOOP_CB(tmr_cb), NULL, COLDPLUG_POLL, COLDPLUG_POLL);
+		return;
+	}
+
+mdev:
+	path = which("mdev");
+	if (path) {
+		/* Embedded Linux systems usually have BusyBox mdev */
+		if (debug)
+			touch("/dev/mdev.log");
+
+		snprintf(cmd, sizeof(cmd), "%s -s", path);
+		free(path);
+
+		run_interactive(cmd, "Populating device tree");
 	}
+
+	cond_set_oneshot(COLDPLUG_COND);
 }
 
 static plugin_t plugin = {
@@ -169,7 +169,7 @@ static void coldplug(void *arg)
 
 static plugin_t plugin = {
 	.name = __FILE__,
-	.hook[HOOK_BASEFS_UP] = { .cb  = coldplug },
+	.hook[HOOK_BASEFS_UP] = { .cb  = coldplug, .async = 1 },
 	.depends = { "bootmisc", }
 };
 
@@ -190,7 +190,8 @@ out:
 static plugin_t plugin = {
 	.name = __FILE__,
 	.hook[HOOK_BASEFS_UP] = {
-		.cb  = rtc_restore
+		.cb    = rtc_restore,
+		.async = 1
 	},
 	.hook[HOOK_SHUTDOWN] = {
 		.cb  = rtc_save
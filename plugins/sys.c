@@ -44,7 +44,8 @@ static int sys_add_path(struct iwatch *iw, char *path)
 /*
  * unlink conditions with no active task/service, otherwise they may
  * trigger inadvertently when calling `initctl reload` to activate
- * a new configuration.
+ * a new configuration.  Except dev/ conditions, they reflect device
+ * presence, not an event, and are owned by keventd.
  */
 static void sys_update_conds(char *dir, char *name, uint32_t mask)
 {
@@ -64,7 +65,7 @@ static void sys_update_conds(char *dir, char *name, uint32_t mask)
 
 	cond += strlen(COND_BASE) + 1;
 	_d("cond: %s set: %d", cond, mask & IN_CREATE ? 1 : 0);
-	if (!cond_update(cond))
+	if (!cond_update(cond) && strncmp(cond, COND_DEV, strlen(COND_DEV)))
 		unlink(path);
 }
 
@@ -155,29 +156,37 @@ static void sys_callback(void *arg, int fd, int events)
 	}
 }
 
-static void sys_init(void *arg)
+static void sys_watch(char *dir, char *cond)
 {
-	char sysdir[MAX_ARG_LEN];
+	char rundir[MAX_ARG_LEN];
 	char *path;
 
-	if (mkpath(pid_runpath(_PATH_CONDSYS, sysdir, sizeof(sysdir)), 0755) && errno != EEXIST) {
-		_pe("Failed creating %s condition directory, %s", COND_SYS, _PATH_CONDSYS);
+	if (mkpath(pid_runpath(dir, rundir, sizeof(rundir)), 0755) && errno != EEXIST) {
+		_pe("Failed creating %s condition directory, %s", cond, dir);
 		return;
 	}
 
-	path = realpath(_PATH_CONDSYS, NULL);
+	path = realpath(dir, NULL);
 	if (!path) {
-		_pe("Cannot figure out real path to %s, aborting", _PATH_CONDSYS);
+		_pe("Cannot figure out real path to %s, aborting", dir);
 		return;
 	}
 
 	if (iwatch_add(&iw_sys, path, IN_ONLYDIR))
-		iwatch_exit(&iw_sys);
+		_pe("Failed watching %s", path);
+	free(path);
+}
+
+static void sys_init(void *arg)
+{
+	sys_watch(_PATH_CONDSYS, COND_SYS);
+	sys_watch(_PATH_CONDDEV, COND_DEV);
 }
 
 static plugin_t plugin = {
 	.name = __FILE__,
 	.hook[HOOK_BASEFS_UP]  = { .cb = sys_init },
+	.hook[HOOK_RESUME]     = { .cb = sys_init },
 };
 
 PLUGIN_INIT(plugin_init)
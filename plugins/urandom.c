@@ -159,7 +159,7 @@ static void save(void *arg)
 
 static plugin_t plugin = {
 	.name = __FILE__,
-	.hook[HOOK_BASEFS_UP] = { .cb  = setup },
+	.hook[HOOK_BASEFS_UP] = { .cb  = setup, .async = 1 },
 	.hook[HOOK_SHUTDOWN]  = { .cb  = save  },
 	.depends = { "bootmisc", }
 };
@@ -104,6 +104,7 @@ static void usr_init(void *arg)
 static plugin_t plugin = {
 	.name = __FILE__,
 	.hook[HOOK_BASEFS_UP]  = { .cb = usr_init },
+	.hook[HOOK_RESUME]     = { .cb = usr_init },
 };
 
 PLUGIN_INIT(plugin_init)
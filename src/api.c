@@ -24,6 +24,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -42,15 +45,406 @@
 #include "conf.h"
 #include "helpers.h"
 #include "log.h"
+#include "logbuf.h"
+#include "loop.h"
+#include "metrics.h"
 #include "plugin.h"
 #include "private.h"
+#include "reexec.h"
+#include "schedule.h"
 #include "sig.h"
 #include "service.h"
 #include "util.h"
 
+#define API_MAX_CONN    32		/* Stop accepting new clients beyond this */
+#define API_IDLE_MSEC   30000		/* Drop clients not sending any request */
+#define API_WRITE_MSEC  5000		/* Drop clients not reading their replies */
+#define API_QUEUE_MAX   (4 << 20)	/* Max bytes of replies queued per client */
+
 extern svc_t *wdog;
 static uev_t api_watcher;
 
+/*
+ * Replies not yet accepted by the client socket, one per packet.
+ */
+struct pkt {
+	TAILQ_ENTRY(pkt) link;
+	size_t len;
+	char   data[];
+};
+
+/*
+ * Each client connection has its own watcher, so a client can send
+ * many requests on one connection.  Sockets are non-blocking, replies
+ * the client is not ready for are queued and we stop reading requests
+ * until the queue has been drained.  A timer guards each connection,
+ * so a stopped client cannot hold on to a connection forever.
+ */
+struct conn {
+	TAILQ_ENTRY(conn) link;
+	uev_t  watcher;
+	uev_t  timer;
+
+	TAILQ_HEAD(, pkt) queue;
+	size_t queued;			/* Bytes in queue */
+	int    writing;			/* Waiting for client to read */
+	int    error;
+
+	struct wait *wait;		/* Parked request */
+};
+
+/*
+ * A request parked until its services have reached the state the
+ * client waits for, or failed.  The connection is on hold meanwhile,
+ * later requests are served when the reply has been sent.
+ */
+struct wait {
+	TAILQ_ENTRY(wait) link;
+	struct conn *conn;
+	struct init_request rq;
+	uev_t  timer;
+	int    cmd;			/* Action to wait for */
+
+	int    num;
+	struct {
+		int  job;
+		char id[MAX_ID_LEN];
+	} *svc;
+};
+static TAILQ_HEAD(, wait) waits = TAILQ_HEAD_INITIALIZER(waits);
+static struct wait *parking;		/* For wait_add() */
+
+static void wait_check(void *arg);
+static struct wq wait_work = {
+	.cb = wait_check,
+};
+
+static TAILQ_HEAD(, conn) conns = TAILQ_HEAD_INITIALIZER(conns);
+static struct conn *serving;		/* In conn_cb(), see api_exit() */
+static int num_conns;
+static int paused;			/* At API_MAX_CONN, listener stopped */
+
+/*
+ * Send a reply, or queue it if the client is not ready for it.  Never
+ * blocks, so a client that does not read its replies cannot stall us.
+ */
+static int conn_send(struct conn *c, const void *buf, size_t len)
+{
+	struct pkt *p;
+
+	if (c->error)
+		return 1;
+
+	if (TAILQ_EMPTY(&c->queue)) {
+		if (send(c->watcher.fd, buf, len, MSG_NOSIGNAL) == (ssize_t)len)
+			return 0;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			goto fail;
+	}
+
+	if (c->queued + len > API_QUEUE_MAX) {
+		errno = ENOBUFS;
+		goto fail;
+	}
+
+	p = malloc(sizeof(*p) + len);
+	if (!p)
+		goto fail;
+
+	memcpy(p->data, buf, len);
+	p->len = len;
+	TAILQ_INSERT_TAIL(&c->queue, p, link);
+	c->queued += len;
+
+	return 0;
+fail:
+	_d("Failed sending reply to client: %s", strerror(errno));
+	c->error = 1;
+	return 1;
+}
+
+/* Send as much of the queue as the client is ready for */
+static int conn_flush(struct conn *c)
+{
+	struct pkt *p;
+
+	while ((p = TAILQ_FIRST(&c->queue))) {
+		if (send(c->watcher.fd, p->data, p->len, MSG_NOSIGNAL) != (ssize_t)p->len) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+
+			_d("Failed sending reply to client: %s", strerror(errno));
+			return 1;
+		}
+
+		TAILQ_REMOVE(&c->queue, p, link);
+		c->queued -= p->len;
+		free(p);
+	}
+
+	return 0;
+}
+
+/*
+ * Either wait for the client to read its replies, or for its next
+ * request.  The deadline is restarted on every call.
+ */
+static void conn_update(struct conn *c)
+{
+	int writing = !TAILQ_EMPTY(&c->queue);
+
+	/* Parked, the wait has its own deadline */
+	if (c->wait) {
+		uev_io_stop(&c->watcher);
+		uev_timer_stop(&c->timer);
+		c->writing = -1;
+		return;
+	}
+
+	if (writing != c->writing) {
+		c->writing = writing;
+		uev_io_set(&c->watcher, c->watcher.fd, writing ? UEV_WRITE : UEV_READ);
+	}
+
+	uev_timer_set(&c->timer, writing ? API_WRITE_MSEC : API_IDLE_MSEC, 0);
+}
+
+static void wait_free(struct wait *w)
+{
+	uev_timer_stop(&w->timer);
+	TAILQ_REMOVE(&waits, w, link);
+	w->conn->wait = NULL;
+	free(w->svc);
+	free(w);
+}
+
+static void conn_close(struct conn *c)
+{
+	struct pkt *p;
+
+	if (c->wait)
+		wait_free(c->wait);
+
+	uev_timer_stop(&c->timer);
+	uev_io_stop(&c->watcher);
+	close(c->watcher.fd);
+
+	while ((p = TAILQ_FIRST(&c->queue))) {
+		TAILQ_REMOVE(&c->queue, p, link);
+		free(p);
+	}
+
+	TAILQ_REMOVE(&conns, c, link);
+	free(c);
+
+	num_conns--;
+	if (paused) {
+		paused = 0;
+		uev_io_start(&api_watcher);
+	}
+}
+
+static void conn_timeout(uev_t *w, void *arg, int events)
+{
+	struct conn *c = (struct conn *)arg;
+
+	(void)w;
+	(void)events;
+	_d("Dropping API client, %s", c->writing ? "not reading replies" : "idle");
+	conn_close(c);
+}
+LOOP_PROBE(conn_timeout)
+
+static int wait_add(svc_t *svc)
+{
+	struct wait *w = parking;
+	void *ptr;
+
+	ptr = realloc(w->svc, (w->num + 1) * sizeof(*w->svc));
+	if (!ptr)
+		return 1;
+
+	w->svc = ptr;
+	w->svc[w->num].job = svc->job;
+	strlcpy(w->svc[w->num].id, svc->id, sizeof(w->svc[w->num].id));
+	w->num++;
+
+	return 0;
+}
+
+/*
+ * Returns 1 when @svc has reached the state @cmd waits for, -1 if it
+ * never will, with @why set, and 0 if we need to wait some more.
+ */
+static int wait_done(int cmd, svc_t *svc, const char **why)
+{
+	char cond[MAX_COND_LEN];
+
+	if (cmd == INIT_CMD_STOP_SVC) {
+		if (!svc)
+			return 1;
+		if (svc->pid)
+			return 0;
+		return svc->state == SVC_HALTED_STATE || svc->state == SVC_DONE_STATE;
+	}
+
+	if (!svc) {
+		*why = "removed";
+		return -1;
+	}
+
+	switch (svc->block) {
+	case SVC_BLOCK_MISSING:
+	case SVC_BLOCK_CRASHING:
+	case SVC_BLOCK_USER:
+		*why = svc_status(svc);
+		return -1;
+
+	default:
+		break;
+	}
+
+	switch (svc->state) {
+	case SVC_HALTED_STATE:
+		if (!svc_in_runlevel(svc, runlevel)) {
+			*why = "not in this runlevel";
+			return -1;
+		}
+		break;
+
+	case SVC_DONE_STATE:
+		return svc_is_runtask(svc);
+
+	case SVC_RUNNING_STATE:
+		if (svc_is_runtask(svc))
+			break;
+		if (!svc_is_daemon(svc))
+			return 1;
+
+		/* Ready when the service has created its PID file */
+		if (svc_is_starting(svc))
+			break;
+		return cond_get(mkcond(svc, cond, sizeof(cond))) == COND_ON;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static void wait_reply(struct wait *w, int result)
+{
+	struct conn *c = w->conn;
+
+	w->rq.cmd = result ? INIT_CMD_NACK : INIT_CMD_ACK;
+	conn_send(c, &w->rq, sizeof(w->rq));
+	wait_free(w);
+
+	if (c->error)
+		conn_close(c);
+	else
+		conn_update(c);
+}
+
+static void wait_check(void *arg)
+{
+	struct wait *w, *tmp;
+
+	(void)arg;
+	TAILQ_FOREACH_SAFE(w, &waits, link, tmp) {
+		const char *why = NULL;
+		svc_t *svc = NULL;
+		int i, rc = 1;
+
+		for (i = 0; rc == 1 && i < w->num; i++) {
+			svc = svc_find_by_jobid(w->svc[i].job, w->svc[i].id);
+			rc  = wait_done(w->cmd, svc, &why);
+		}
+
+		if (!rc)
+			continue;
+
+		if (rc < 0)
+			snprintf(w->rq.data, sizeof(w->rq.data), "%s %s",
+				 svc ? svc_ident(svc, NULL, 0) : "service", why);
+		wait_reply(w, rc < 0);
+	}
+}
+
+static void wait_timeout(uev_t *t, void *arg, int events)
+{
+	struct wait *w = (struct wait *)arg;
+	const char *why = NULL;
+	svc_t *svc = NULL;
+	int i;
+
+	(void)t;
+	(void)events;
+	for (i = 0; i < w->num; i++) {
+		svc = svc_find_by_jobid(w->svc[i].job, w->svc[i].id);
+		if (wait_done(w->cmd, svc, &why) != 1)
+			break;
+	}
+
+	snprintf(w->rq.data, sizeof(w->rq.data), "Timeout waiting for %s",
+		 svc ? svc_ident(svc, NULL, 0) : "service");
+	wait_reply(w, 1);
+}
+LOOP_PROBE(wait_timeout)
+
+/*
+ * Park request until all services in @svcs have reached the state for
+ * @cmd.  The reply is sent from wait_check(), or wait_timeout().
+ *
+ * Returns:
+ * POSIX OK(0) if parked, non-zero if there is nothing to wait for.
+ */
+static int wait_park(struct conn *c, struct init_request *rq, int cmd, char *svcs, size_t len)
+{
+	struct wait *w;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return 1;
+
+	parking = w;
+	svc_parse_jobstr(svcs, len, wait_add, NULL);
+	parking = NULL;
+	if (!w->num)
+		goto fail;
+
+	if (uev_timer_init(c->watcher.ctx, &w->timer, LOOP_CB(wait_timeout), w, rq->sleeptime * 1000, 0))
+		goto fail;
+
+	memcpy(&w->rq, rq, sizeof(w->rq));
+	w->conn = c;
+	w->cmd  = cmd;
+	TAILQ_INSERT_TAIL(&waits, w, link);
+	c->wait = w;
+
+	/* Services may already be there */
+	schedule_work(&wait_work);
+
+	return 0;
+fail:
+	free(w->svc);
+	free(w);
+	return 1;
+}
+
+/**
+ * api_notify - Service state, or a condition, has changed
+ *
+ * Called on every change, so parked requests are checked as soon as
+ * possible, but not until the current state transitions are done.
+ */
+void api_notify(void)
+{
+	if (!TAILQ_EMPTY(&waits))
+		schedule_work(&wait_work);
+}
+
 static int call(int (*action)(svc_t *), char *buf, size_t len)
 {
 	return svc_parse_jobstr(buf, len, action, NULL);
@@ -204,6 +598,202 @@ static svc_t *do_find_byc(char *buf, size_t len)
 	return NULL;
 }
 
+static int is_match(svc_t *svc, struct svc_match *m, regex_t *re, char *ident, size_t len)
+{
+	char job[MAX_IDENT_LEN];
+
+	if (m->type && !(m->type & svc->type))
+		return 0;
+	if (m->state && !(m->state & (1 << svc->state)))
+		return 0;
+
+	svc_ident(svc, ident, len);
+	if (!m->pattern[0])
+		return 1;
+
+	switch (m->flags & SVC_MATCH_MODE) {
+	case SVC_MATCH_GLOB:
+		return !fnmatch(m->pattern, ident, 0);
+
+	case SVC_MATCH_REGEX:
+		return !regexec(re, ident, 0, NULL, 0);
+
+	default:
+		break;
+	}
+
+	if (string_compare(ident, m->pattern) || string_compare(svc->name, m->pattern))
+		return 1;
+
+	snprintf(job, sizeof(job), "%d", svc->job);
+	if (string_compare(job, m->pattern))
+		return 1;
+	snprintf(job, sizeof(job), "%d:%s", svc->job, svc->id);
+
+	return string_compare(job, m->pattern);
+}
+
+/*
+ * Reply with all matching services in one go, instead of the client
+ * having to iterate over all of them, one connection per service.
+ */
+static int do_match(struct conn *c, struct init_request *rq)
+{
+	struct svc_match *m = (struct svc_match *)rq->data;
+	svc_t *svc, *iter = NULL;
+	int num = 0, exact = 0;
+	int mode, rc = 0;
+	regex_t re;
+
+	strterm(m->pattern, sizeof(m->pattern));
+	mode = m->flags & SVC_MATCH_MODE;
+	if (mode == SVC_MATCH_REGEX && m->pattern[0]) {
+		if (regcomp(&re, m->pattern, REG_EXTENDED | REG_NOSUB)) {
+			_d("Invalid regex: %s", m->pattern);
+			return 1;
+		}
+	}
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		char ident[MAX_IDENT_LEN];
+
+		if (!is_match(svc, m, &re, ident, sizeof(ident)))
+			continue;
+
+		num++;
+		if (string_case_compare(ident, m->pattern))
+			exact++;
+
+		if (m->flags & SVC_MATCH_COUNT)
+			continue;
+
+		if (conn_send(c, svc, sizeof(*svc))) {
+			rc = 1;
+			break;
+		}
+	}
+
+	if (mode == SVC_MATCH_REGEX && m->pattern[0])
+		regfree(&re);
+
+	rq->runlevel  = num;
+	rq->sleeptime = exact;
+
+	return rc;
+}
+
+static struct conn *cond_conn;
+static unsigned int cond_rgen;
+
+static void cond_owner(struct cond_rec *rec)
+{
+	char ident[MAX_IDENT_LEN];
+	char *id;
+	svc_t *svc;
+
+	strlcpy(rec->owner, "init", sizeof(rec->owner));
+	rec->pid = 1;
+
+	if (!strncmp(rec->name, COND_PID, strlen(COND_PID))) {
+		strlcpy(ident, &rec->name[strlen(COND_PID)], sizeof(ident));
+		id = strchr(ident, ':');
+		if (id)
+			*id++ = 0;
+
+		svc = svc_find_by_nameid(ident, id);
+		if (!svc) {
+			strlcpy(rec->owner, "unknown", sizeof(rec->owner));
+			rec->pid = 0;
+		} else {
+			svc_ident(svc, rec->owner, sizeof(rec->owner));
+			rec->pid = svc->pid;
+		}
+	} else if (!strncmp(rec->name, COND_USR, strlen(COND_USR))) {
+		strlcpy(rec->owner, "static", sizeof(rec->owner));
+		rec->pid = 0;
+	} else if (!strncmp(rec->name, "hook/", 5)) {
+		strlcpy(rec->owner, "static", sizeof(rec->owner));
+	}
+}
+
+static void cond_deps(struct cond_rec *rec)
+{
+	svc_t *svc, *iter = NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		char ident[MAX_IDENT_LEN];
+
+		if (!svc->cond[0] || !cond_affects(rec->name, svc->cond))
+			continue;
+
+		if (rec->num_deps++)
+			strlcat(rec->deps, ",", sizeof(rec->deps));
+		strlcat(rec->deps, svc_ident(svc, ident, sizeof(ident)), sizeof(rec->deps));
+	}
+}
+
+static int send_cond(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+{
+	struct cond_rec rec = { 0 };
+
+	if (tflag != FTW_F || !strcmp(fpath, _PATH_RECONF))
+		return 0;
+
+	strlcpy(rec.name, &fpath[strlen(_PATH_COND)], sizeof(rec.name));
+	rec.gen = cond_get_gen(fpath);
+	if (!rec.gen || !cond_rgen)
+		rec.state = COND_OFF;
+	else
+		rec.state = rec.gen == cond_rgen ? COND_ON : COND_FLUX;
+
+	cond_owner(&rec);
+	cond_deps(&rec);
+
+	if (conn_send(cond_conn, &rec, sizeof(rec)))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Walk all conditions once, resolving owner and dependents here in
+ * PID 1, instead of initctl asking for the owner of each condition.
+ */
+static int send_conds(struct conn *c)
+{
+	cond_conn = c;
+	cond_rgen = cond_get_gen(_PATH_RECONF);
+
+	return nftw(_PATH_COND, send_cond, 20, FTW_PHYS) != 0;
+}
+
+/*
+ * Send buffered output of a service, from the requested offset, in
+ * chunks.  Follow mode in initctl polls with the offset of the end.
+ */
+static int send_log(struct conn *c, struct init_request *rq)
+{
+	struct logbuf_req *req = (struct logbuf_req *)rq->data;
+	struct logbuf_rec rec;
+	uint64_t offset;
+	svc_t *svc;
+
+	strterm(req->ident, sizeof(req->ident));
+	svc = do_find(req->ident, sizeof(req->ident));
+	if (!svc || !svc->logbuf)
+		return 1;
+
+	offset = req->offset;
+	while ((rec.len = logbuf_read(svc->logbuf, &offset, rec.data, sizeof(rec.data)))) {
+		rec.offset = offset;
+		if (conn_send(c, &rec, sizeof(rec)))
+			return 1;
+		offset += rec.len;
+	}
+
+	return 0;
+}
+
 static int do_reboot(int cmd, char *buf, size_t len)
 {
 	int rc = 1;
@@ -257,58 +847,82 @@ ev_t ev_list[] = {
 	{ NULL, NULL }
 };
 
-static void send_svc(int sd, svc_t *svc)
+static void send_svc(struct conn *c, svc_t *svc)
 {
 	svc_t empty = { 0 };
-	size_t len;
 
 	if (!svc) {
 		empty.pid = -1;
 		svc = &empty;
 	}
 
-	len = write(sd, svc, sizeof(*svc));
-	if (len != sizeof(*svc))
-		_d("Failed sending svc_t to client");
+	conn_send(c, svc, sizeof(*svc));
 }
 
-static void api_cb(uev_t *w, void *arg, int events)
+static int send_probes(struct conn *c)
+{
+	struct probe *p, *iter = NULL;
+
+	for (p = loop_iterator(&iter, 1); p; p = loop_iterator(&iter, 0)) {
+		if (conn_send(c, p, sizeof(*p)))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Serve all requests queued on a client connection.  Replies are sent
+ * in the same order as the requests, which is how a client pipelining
+ * requests matches them.  The connection is kept until the client
+ * closes it, or on error.
+ */
+static void conn_cb(uev_t *w, void *arg, int events)
 {
 	static svc_t *iter = NULL;
+	struct conn *c = (struct conn *)arg;
 	struct init_request rq;
-	int sd, lvl;
+	uint64_t start = 0;
+	int sd = w->fd;
+	int lvl;
 	svc_t *svc;
 
-	sd = accept(w->fd, NULL, NULL);
-	if (sd < 0) {
-		_pe("Failed serving API request");
-		goto error;
-	}
+	if (UEV_ERROR == events)
+		goto leave;
+
+	if (conn_flush(c))
+		goto leave;
 
-	while (1) {
+	serving = c;
+
+	/* Replies are sent in order, so wait for the queue to drain */
+	while (TAILQ_EMPTY(&c->queue) && !c->wait) {
+		char svcs[sizeof(rq.data)];
+		int wait_cmd = 0;
 		int result = 0;
 		ssize_t len;
 
-		len = read(sd, &rq, sizeof(rq));
+		len = recv(sd, &rq, sizeof(rq), 0);
 		if (len <= 0) {
 			if (-1 == len) {
 				if (EINTR == errno)
 					continue;
 
-				if (EAGAIN == errno)
+				if (EAGAIN == errno || EWOULDBLOCK == errno)
 					break;
 
 				_e("Failed reading initctl request, error %d: %s", errno, strerror(errno));
 			}
 
-			break;
+			goto leave;
 		}
 
 		if (rq.magic != INIT_MAGIC || len != sizeof(rq)) {
 			_e("Invalid initctl request");
-			break;
+			goto leave;
 		}
 
+		start = mono_usec();
 		switch (rq.cmd) {
 		case INIT_CMD_RUNLVL:
 			switch (rq.runlevel) {
@@ -346,27 +960,54 @@ static void api_cb(uev_t *w, void *arg, int events)
 		case INIT_CMD_START_SVC:
 			_d("start %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
+			strlcpy(svcs, rq.data, sizeof(svcs));
+			wait_cmd = INIT_CMD_START_SVC;
 			result = do_start(rq.data, sizeof(rq.data));
 			break;
 
 		case INIT_CMD_RESTART_SVC:
 			_d("restart %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
+			strlcpy(svcs, rq.data, sizeof(svcs));
+			wait_cmd = INIT_CMD_RESTART_SVC;
 			result = do_restart(rq.data, sizeof(rq.data));
 			break;
 
 		case INIT_CMD_STOP_SVC:
 			_d("stop %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
+			strlcpy(svcs, rq.data, sizeof(svcs));
+			wait_cmd = INIT_CMD_STOP_SVC;
 			result = do_stop(rq.data, sizeof(rq.data));
 			break;
 
 		case INIT_CMD_RELOAD_SVC:
 			_d("reload %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
+			strlcpy(svcs, rq.data, sizeof(svcs));
+			wait_cmd = INIT_CMD_RELOAD_SVC;
 			result = do_reload(rq.data, sizeof(rq.data));
 			break;
 
+		case INIT_CMD_SVC_WAIT:
+			_d("svc wait %s", rq.data);
+			strterm(rq.data, sizeof(rq.data));
+			strlcpy(svcs, rq.data, sizeof(svcs));
+			switch (rq.runlevel) {
+			case INIT_CMD_START_SVC:
+			case INIT_CMD_STOP_SVC:
+			case INIT_CMD_RESTART_SVC:
+			case INIT_CMD_RELOAD_SVC:
+				wait_cmd = rq.runlevel;
+				if (rq.sleeptime > 0)
+					break;
+				/* fallthrough */
+			default:
+				result = 1;
+				break;
+			}
+			break;
+
 		case INIT_CMD_GET_RUNLEVEL:
 			_d("get runlevel");
 			rq.runlevel  = runlevel;
@@ -422,8 +1063,8 @@ static void api_cb(uev_t *w, void *arg, int events)
 			 * have to do for now.
 			 */
 			svc = svc_iterator(&iter, rq.runlevel);
-			send_svc(sd, svc);
-			goto leave;
+			send_svc(c, svc);
+			goto next;
 
 		case INIT_CMD_SVC_QUERY:
 			_d("svc query: %s", rq.data);
@@ -434,39 +1075,132 @@ static void api_cb(uev_t *w, void *arg, int events)
 		case INIT_CMD_SVC_FIND:
 			_d("svc find: %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
-			send_svc(sd, do_find(rq.data, sizeof(rq.data)));
-			goto leave;
+			send_svc(c, do_find(rq.data, sizeof(rq.data)));
+			goto next;
 
 		case INIT_CMD_SVC_FIND_BYC:
 			_d("svc find by cond: %s", rq.data);
 			strterm(rq.data, sizeof(rq.data));
-			send_svc(sd, do_find_byc(rq.data, sizeof(rq.data)));
-			goto leave;
+			send_svc(c, do_find_byc(rq.data, sizeof(rq.data)));
+			goto next;
+
+		case INIT_CMD_SVC_MATCH:
+			_d("svc match");
+			result = do_match(c, &rq);
+			break;
+
+		case INIT_CMD_COND_DUMP:
+			_d("cond dump");
+			result = send_conds(c);
+			break;
+
+		case INIT_CMD_SVC_LOG:
+			_d("svc log");
+			result = send_log(c, &rq);
+			break;
+
+		case INIT_CMD_LOOP_STATS:
+			_d("loop stats");
+			result = send_probes(c);
+			break;
+
+		case INIT_CMD_REEXEC:
+			_d("reexec");
+			result = reexec_start();
+			break;
 
 		default:
 			_d("Unsupported cmd: %d", rq.cmd);
 			break;
 		}
 
+		/* Reply when the services are done, not now */
+		if (wait_cmd && rq.sleeptime > 0) {
+			if (!result && !wait_park(c, &rq, wait_cmd, svcs, sizeof(svcs)))
+				goto next;
+
+			snprintf(rq.data, sizeof(rq.data), "Cannot wait for %s", svcs);
+			result = 1;
+		}
+
 		if (result)
 			rq.cmd = INIT_CMD_NACK;
 		else
 			rq.cmd = INIT_CMD_ACK;
-		len = write(sd, &rq, sizeof(rq));
-		if (len != sizeof(rq))
-			_d("Failed sending ACK/NACK back to client");
+		conn_send(c, &rq, sizeof(rq));
+	next:
+		metrics_api(start);
+		start = 0;
+
+		if (c->error)
+			goto leave;
 	}
 
+	serving = NULL;
+	conn_update(c);
+	return;
 leave:
-	close(sd);
+	serving = NULL;
+	if (start)
+		metrics_api(start);
+	conn_close(c);
+}
+LOOP_PROBE(conn_cb)
+
+static void api_cb(uev_t *w, void *arg, int events)
+{
+	struct conn *c;
+	int sd;
+
 	if (UEV_ERROR == events)
 		goto error;
+
+	sd = accept4(w->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (sd < 0) {
+		if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+			return;
+		_pe("Failed serving API request");
+		goto error;
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		_pe("Failed allocating API connection");
+		close(sd);
+		return;
+	}
+	TAILQ_INIT(&c->queue);
+
+	if (uev_timer_init(w->ctx, &c->timer, LOOP_CB(conn_timeout), c, API_IDLE_MSEC, 0)) {
+		_pe("Failed setting up API connection");
+		goto fail;
+	}
+
+	if (uev_io_init(w->ctx, &c->watcher, LOOP_CB(conn_cb), c, sd, UEV_READ)) {
+		_pe("Failed setting up API connection");
+		uev_timer_stop(&c->timer);
+		goto fail;
+	}
+	TAILQ_INSERT_TAIL(&conns, c, link);
+
+	/* Remaining clients wait in the listen() backlog */
+	if (++num_conns >= API_MAX_CONN) {
+		_d("Max %d API connections, pausing.", API_MAX_CONN);
+		uev_io_stop(w);
+		paused = 1;
+	}
+
+	return;
+fail:
+	close(sd);
+	free(c);
 	return;
 error:
 	api_exit();
 	if (api_init(w->ctx))
 		_e("Unrecoverable error on API socket");
 }
+LOOP_PROBE(api_cb)
 
 int api_init(uev_ctx_t *ctx)
 {
@@ -478,6 +1212,18 @@ int api_init(uev_ctx_t *ctx)
 	int uid, gid;
 	int sd;
 
+	/* Already bound and listening, from before initctl reexec */
+	sd = reexec_fd("api");
+	if (sd != -1) {
+		_d("Resuming external API socket ...");
+		fcntl(sd, F_SETFD, FD_CLOEXEC);
+		if (!uev_io_init(ctx, &api_watcher, LOOP_CB(api_cb), NULL, sd, UEV_READ))
+			return 0;
+
+		_pe("Failed resuming API socket");
+		close(sd);
+	}
+
 	_d("Setting up external API socket ...");
 	sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
 	if (-1 == sd) {
@@ -500,7 +1246,7 @@ int api_init(uev_ctx_t *ctx)
 		_pe("Failed setting group %s on %s", DEFGROUP, INIT_SOCKET);
 
 	umask(oldmask);
-	if (!uev_io_init(ctx, &api_watcher, api_cb, NULL, sd, UEV_READ))
+	if (!uev_io_init(ctx, &api_watcher, LOOP_CB(api_cb), NULL, sd, UEV_READ))
 		return 0;
 
 error:
@@ -510,8 +1256,43 @@ error:
 	return 1;
 }
 
+/*
+ * Called before re-exec, all clients are disconnected, they reconnect
+ * to the new Finit.  Returns the listening socket to be handed over.
+ */
+int api_suspend(void)
+{
+	struct conn *c, *tmp;
+
+	paused = 0;
+	TAILQ_FOREACH_SAFE(c, &conns, link, tmp)
+		conn_close(c);
+
+	uev_io_stop(&api_watcher);
+
+	return api_watcher.fd;
+}
+
+/* Re-exec failed, continue accepting clients */
+void api_resume(void)
+{
+	uev_io_start(&api_watcher);
+}
+
 int api_exit(void)
 {
+	struct conn *c, *tmp;
+
+	paused = 0;
+	TAILQ_FOREACH_SAFE(c, &conns, link, tmp) {
+		/* Called by a request, e.g. reboot, closed when it returns */
+		if (c == serving) {
+			c->error = 1;
+			continue;
+		}
+		conn_close(c);
+	}
+
 	uev_io_stop(&api_watcher);
 
 	return close(api_watcher.fd);
@@ -38,6 +38,7 @@
 #include "finit.h"
 #include "iwatch.h"
 #include "log.h"
+#include "loop.h"
 #include "util.h"
 
 struct cg {
@@ -292,6 +293,7 @@ static void cgroup_events_cb(uev_t *w, void *arg, int events)
 		service_reload_dynamic();
 #endif
 }
+LOOP_PROBE(cgroup_events_cb)
 
 static struct cg *cgroup_find(char *name)
 {
@@ -463,7 +465,8 @@ void cgroup_init(uev_ctx_t *ctx)
 	FILE *fp;
 	int fd;
 
-	if (mount("none", FINIT_CGPATH, "cgroup2", opts, NULL)) {
+	/* Already mounted if we have been re-executed */
+	if (!fismnt(FINIT_CGPATH) && mount("none", FINIT_CGPATH, "cgroup2", opts, NULL)) {
 		if (errno == ENOENT)
 			logit(LOG_NOTICE, "Kernel does not support cgroups v2, disabling.");
 		else if (errno == EPERM) /* Probably inside an unpriviliged container */
@@ -511,7 +514,7 @@ void cgroup_init(uev_ctx_t *ctx)
 
 	/* prepare cgroup.events watcher */
 	fd = iwatch_init(&iw_cgroup);
-	if (uev_io_init(ctx, &cgw, cgroup_events_cb, NULL, fd, UEV_READ)) {
+	if (uev_io_init(ctx, &cgw, LOOP_CB(cgroup_events_cb), NULL, fd, UEV_READ)) {
 		_pe("Failed setting up cgroup.events watcher");
 		iwatch_exit(&iw_cgroup);
 		close(fd);
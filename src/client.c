@@ -30,6 +30,9 @@
 #include "client.h"
 
 static int sd = -1;
+static int session;
+
+static void client_abort(void);
 
 int client_connect(void)
 {
@@ -38,7 +41,16 @@ int client_connect(void)
 		.sun_path   = INIT_SOCKET,
 	};
 
-	sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (session && sd != -1) {
+		struct pollfd pfd = { .fd = sd, .events = POLLIN };
+
+		/* Nothing to read between requests, unless Finit hung up */
+		if (poll(&pfd, 1, 0) == 0)
+			return sd;
+		client_abort();
+	}
+
+	sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
 	if (-1 == sd)
 		err(1, "Failed creating UNIX domain socket");
 
@@ -52,6 +64,9 @@ int client_disconnect(void)
 {
 	int rc;
 
+	if (session)
+		return 0;
+
 	if (sd < 0) {
 		errno = EINVAL;
 		return -1;
@@ -63,6 +78,130 @@ int client_disconnect(void)
 	return rc;
 }
 
+/*
+ * On error, replies may be out of sync with our requests.  Drop the
+ * connection, a session reconnects on the next request.
+ */
+static void client_abort(void)
+{
+	if (sd != -1)
+		close(sd);
+	sd = -1;
+}
+
+/*
+ * Finit holds back the reply to requests waiting for services, give
+ * it the requested time plus our usual margin.
+ */
+static int client_timeout(struct init_request *rq)
+{
+	switch (rq->cmd) {
+	case INIT_CMD_START_SVC:
+	case INIT_CMD_STOP_SVC:
+	case INIT_CMD_RESTART_SVC:
+	case INIT_CMD_RELOAD_SVC:
+	case INIT_CMD_SVC_WAIT:
+		if (rq->sleeptime > 0)
+			return 2000 + rq->sleeptime * 1000;
+		break;
+
+	default:
+		break;
+	}
+
+	return 2000;
+}
+
+/**
+ * client_session_open - Keep one connection for all following requests
+ *
+ * Until client_session_close(), all client_*() functions reuse the same
+ * connection to Finit, instead of connecting once per request.  The
+ * connection is set up on the first request.
+ */
+void client_session_open(void)
+{
+	session = 1;
+}
+
+void client_session_close(void)
+{
+	session = 0;
+	if (sd != -1)
+		client_disconnect();
+}
+
+/**
+ * client_pipeline - Send many requests, then collect the replies
+ * @rq:  Array of requests, each holds its ACK/NACK on return
+ * @num: Number of requests in @rq
+ *
+ * Requests are written ahead of the replies, at most %CLIENT_WINDOW at
+ * a time, so a list of commands costs one round trip instead of one
+ * per command.  Finit serves requests on a connection in order, so the
+ * n:th reply belongs to the n:th request.  Only commands replying with
+ * a single ACK/NACK can be pipelined.
+ *
+ * Returns:
+ * Number of requests NACKed by Finit, or -1 on communication error.
+ */
+int client_pipeline(struct init_request *rq, size_t num)
+{
+	struct pollfd pfd = { 0 };
+	size_t sent = 0, rcvd = 0;
+	int result = 0;
+
+	if (client_connect() == -1)
+		return -1;
+
+	pfd.fd = sd;
+	while (rcvd < num) {
+		int rc;
+
+		pfd.events = POLLIN;
+		if (sent < num && sent - rcvd < CLIENT_WINDOW)
+			pfd.events |= POLLOUT;
+
+		rc = poll(&pfd, 1, client_timeout(&rq[rcvd]));
+		if (rc <= 0) {
+			if (rc)
+				warn("poll(), errno %d", errno);
+			else
+				warnx("Timed out waiting for reply from Finit.");
+			goto error;
+		}
+
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			warnx("Finit closed connection.");
+			goto error;
+		}
+
+		if (pfd.revents & POLLOUT) {
+			if (write(sd, &rq[sent], sizeof(rq[sent])) != sizeof(rq[sent])) {
+				warn("Failed communicating with Finit, errno %d", errno);
+				goto error;
+			}
+			sent++;
+		}
+
+		if (pfd.revents & POLLIN) {
+			if (read(sd, &rq[rcvd], sizeof(rq[rcvd])) != sizeof(rq[rcvd])) {
+				warn("Failed reading reply from Finit, errno %d", errno);
+				goto error;
+			}
+			if (rq[rcvd].cmd == INIT_CMD_NACK)
+				result++;
+			rcvd++;
+		}
+	}
+
+	client_disconnect();
+	return result;
+error:
+	client_abort();
+	return -1;
+}
+
 int client_send(struct init_request *rq, ssize_t len)
 {
 	struct pollfd pfd = { 0 };
@@ -87,7 +226,7 @@ int client_send(struct init_request *rq, ssize_t len)
 
 	pfd.fd = sd;
 	pfd.events = POLLIN | POLLERR | POLLHUP;
-	if ((rc = poll(&pfd, 1, 2000)) <= 0) {
+	if ((rc = poll(&pfd, 1, client_timeout(rq))) <= 0) {
 		if (rc) {
 			if (errno == EINTR) /* shutdown/reboot */
 				goto exit;
@@ -107,7 +246,76 @@ int client_send(struct init_request *rq, ssize_t len)
 	else
 		result = 0;
 exit:
-	client_disconnect();
+	if (result == 255)
+		client_abort();
+	else
+		client_disconnect();
+
+	return result;
+}
+
+/**
+ * client_recv - Send request and receive a series of records
+ * @rq:  Request to send, holds final ACK/NACK on return
+ * @len: Size of one record
+ * @cb:  Called for each record received
+ * @arg: Optional argument to @cb
+ *
+ * Multi-record replies from Finit are sent one record per packet and
+ * end with the request itself, with cmd set to ACK or NACK.  The two
+ * are told apart by their size.
+ *
+ * Returns:
+ * 0 on ACK, 1 on NACK, and -1 on communication error.
+ */
+int client_recv(struct init_request *rq, size_t len, int (*cb)(void *rec, void *arg), void *arg)
+{
+	struct pollfd pfd = { 0 };
+	int result = -1;
+	char *buf;
+	ssize_t n;
+
+	buf = malloc(max(len, sizeof(*rq)));
+	if (!buf)
+		return -1;
+
+	if (client_connect() == -1)
+		goto exit;
+
+	if (write(sd, rq, sizeof(*rq)) != sizeof(*rq)) {
+		warn("Failed communicating with Finit, errno %d", errno);
+		goto exit;
+	}
+
+	pfd.fd     = sd;
+	pfd.events = POLLIN | POLLERR | POLLHUP;
+	while (1) {
+		if (poll(&pfd, 1, 2000) <= 0) {
+			warnx("Timed out waiting for reply from Finit.");
+			break;
+		}
+
+		n = read(sd, buf, max(len, sizeof(*rq)));
+		if (n == sizeof(*rq)) {
+			memcpy(rq, buf, sizeof(*rq));
+			result = rq->cmd == INIT_CMD_NACK ? 1 : 0;
+			break;
+		}
+
+		if (n != (ssize_t)len) {
+			warn("Failed reading reply from Finit, errno %d", errno);
+			break;
+		}
+
+		if (cb && cb(buf, arg))
+			break;
+	}
+exit:
+	if (result == -1)
+		client_abort();
+	else
+		client_disconnect();
+	free(buf);
 
 	return result;
 }
@@ -142,12 +350,63 @@ svc_t *client_svc_iterator(int first)
 	return &svc;
 error:
 	perror("Failed communicating with finit");
-	client_disconnect();
-	sd = -1;
+	client_abort();
 
 	return NULL;
 }
 
+struct svc_list {
+	svc_t *list;
+	int    num;
+};
+
+static int svc_append(void *rec, void *arg)
+{
+	struct svc_list *l = (struct svc_list *)arg;
+	svc_t *list;
+
+	list = realloc(l->list, (l->num + 1) * sizeof(svc_t));
+	if (!list)
+		return 1;
+
+	memcpy(&list[l->num++], rec, sizeof(svc_t));
+	l->list = list;
+
+	return 0;
+}
+
+/**
+ * client_svc_match - Find all services matching a query
+ * @m:     Pattern, type, and state to match
+ * @num:   Number of matches
+ * @exact: Number of matches with NAME:ID equal to pattern, ignoring case
+ *
+ * Returns:
+ * Array of @num svc_t, to be freed by the caller, or %NULL on error or
+ * if nothing matched.  With %SVC_MATCH_COUNT only @num is set.
+ */
+svc_t *client_svc_match(struct svc_match *m, int *num, int *exact)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_SVC_MATCH,
+	};
+	struct svc_list l = { 0 };
+
+	memcpy(rq.data, m, sizeof(*m));
+	if (client_recv(&rq, sizeof(svc_t), svc_append, &l)) {
+		free(l.list);
+		*num = 0;
+		return NULL;
+	}
+
+	*num = rq.runlevel;
+	if (exact)
+		*exact = rq.sleeptime;
+
+	return l.list;
+}
+
 svc_t *do_cmd(int cmd, const char *arg)
 {
 	struct init_request rq = {
@@ -173,7 +432,7 @@ svc_t *do_cmd(int cmd, const char *arg)
 
 	return &svc;
 error:
-	client_disconnect();
+	client_abort();
 	perror("Failed communicating with finit");
 
 	return NULL;
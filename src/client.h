@@ -27,11 +27,20 @@
 #include "finit.h"
 #include "svc.h"
 
+#define CLIENT_WINDOW 16	/* Max requests in flight when pipelining */
+
 int    client_connect          (void);
 int    client_disconnect       (void);
 
+void   client_session_open     (void);
+void   client_session_close    (void);
+
 int    client_send             (struct init_request *rq, ssize_t len);
+int    client_pipeline         (struct init_request *rq, size_t num);
+int    client_recv             (struct init_request *rq, size_t len,
+				int (*cb)(void *rec, void *arg), void *arg);
 svc_t *client_svc_iterator     (int first);
+svc_t *client_svc_match        (struct svc_match *m, int *num, int *exact);
 svc_t *client_svc_find         (const char *arg);
 svc_t *client_svc_find_by_cond (const char *arg);
 
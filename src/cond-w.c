@@ -21,19 +21,26 @@
  * THE SOFTWARE.
  */
 
+#include <fnmatch.h>
 #include <ftw.h>
 #include <libgen.h>
 #include <stdio.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
+# include <libite/queue.h>	/* BSD sys/queue.h API */
 #else
 # include <lite/lite.h>
+# include <lite/queue.h>	/* BSD sys/queue.h API */
 #endif
 
 #include "finit.h"
 #include "cond.h"
+#include "metrics.h"
 #include "pid.h"
+#include "private.h"
+#include "schedule.h"
 #include "service.h"
+#include "util.h"
 
 /*
  * The service condition name is constructed from the 'pid/' prefix and
@@ -164,7 +171,14 @@ int cond_set_path(const char *path, enum cond_state next)
 		return 0;
 	}
 
-	return next != prev;
+	/* Also on reassert, e.g. a touched PID file after SIGHUP */
+	api_notify();
+
+	if (next == prev)
+		return 0;
+
+	metrics.cond_transitions++;
+	return 1;
 }
 
 /* Should only be used by cond_set*(), cond_clear(), and usr/sys plugins! */
@@ -258,11 +272,314 @@ void cond_clear(const char *name)
 	cond_update(name);
 }
 
+static unsigned int restamp_old, restamp_gen;
+
+static int restamp(const char *fpath, const struct stat *sb, int tflg, struct FTW *ftw)
+{
+	/* Skip oneshot symlinks, they always follow reconf */
+	if (tflg != FTW_F)
+		return 0;
+
+	if (strstr(fpath, COND_BASE "/" COND_PID) || strstr(fpath, COND_BASE "/reconf"))
+		return 0;
+
+	/* Already in flux from an earlier reload, not reasserted since */
+	if (cond_get_gen(fpath) != restamp_old)
+		return 0;
+
+	cond_set_gen(fpath, restamp_gen);
+
+	return 0;
+}
+
+/*
+ * Called at `initctl reload` after the new configuration has been read.
+ * All conditions that are on are moved to the new generation except the
+ * pid/ ones of changed and removed services, and of services depending
+ * on them.
+ * Those are put in flux until reasserted, everything else keeps running
+ * without a SIGSTOP/SIGCONT cycle.
+ */
 void cond_reload(void)
 {
+	char cond[MAX_COND_LEN];
+	svc_t *svc, *iter;
+	int again;
+
 	_d("");
 
+	restamp_old = cond_get_gen(_PATH_RECONF);
 	cond_bump_reconf();
+	restamp_gen = cond_get_gen(_PATH_RECONF);
+	if (!restamp_old || !restamp_gen)
+		return;
+
+	nftw(cond_path(""), restamp, 20, FTW_PHYS);
+
+	/*
+	 * Carry over pid/ conditions of unchanged services whose own
+	 * conditions are not in flux.  Repeat until no more change, each
+	 * pass may clear the way for services depending on them.
+	 */
+	do {
+		again = 0;
+		iter = NULL;
+		for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+			if (svc_is_removed(svc) || svc_is_changed(svc))
+				continue;
+
+			mkcond(svc, cond, sizeof(cond));
+			if (cond_get_gen(cond_path(cond)) != restamp_old)
+				continue;
+			if (cond_get_agg(svc->cond) == COND_FLUX)
+				continue;
+
+			_d("%s: unchanged, keeping <%s>", svc->cmd, cond);
+			cond_set_gen(cond_path(cond), restamp_gen);
+			again = 1;
+		}
+	} while (again);
+}
+
+/*
+ * Condition settle time, or hysteresis.  A condition that flaps faster
+ * than its settle time is reported in its last stable state until the
+ * new state has held for the full period.  Set globally or for a set
+ * of condition patterns with cond-settle in finit.conf
+ */
+int cond_settle;
+
+struct settle_rule {
+	TAILQ_ENTRY(settle_rule) link;
+	char *pattern;
+	int   msec;
+};
+
+struct settle {
+	TAILQ_ENTRY(settle) link;
+	char            *name;
+	enum cond_state  raw;		/* Last state read from disk */
+	enum cond_state  stable;	/* Last state reported to callers */
+	uint64_t         changed;	/* mono_usec() when raw changed */
+	uint64_t         suppressed;	/* Changes that never settled */
+};
+
+static TAILQ_HEAD(, settle_rule) settle_rules = TAILQ_HEAD_INITIALIZER(settle_rules);
+static TAILQ_HEAD(, settle) settle_list = TAILQ_HEAD_INITIALIZER(settle_list);
+
+static void settle_work(void *arg);
+static struct wq settle_wq = {
+	.cb = settle_work,
+};
+static uint64_t settle_deadline;
+
+static void settle_work(void *arg)
+{
+	(void)arg;
+
+	settle_deadline = 0;
+	service_step_all(SVC_TYPE_RESPAWN | SVC_TYPE_RUNTASK);
+}
+
+/**
+ * cond_settle_arm - schedule a re-evaluation of all services
+ * @deadline: mono_usec() time when a pending change has settled
+ *
+ * Only the earliest deadline is kept, services re-arming a later one
+ * when they are stepped.
+ */
+void cond_settle_arm(uint64_t deadline)
+{
+	uint64_t now = mono_usec();
+
+	if (settle_deadline && settle_deadline <= deadline)
+		return;
+
+	settle_deadline = deadline;
+	settle_wq.delay = deadline > now ? (int)((deadline - now + 999) / 1000) : 1;
+	schedule_work(&settle_wq);
+}
+
+/**
+ * cond_settle_add - add settle time for conditions
+ * @pattern: fnmatch(3) pattern, or %NULL to set the default
+ * @msec:    settle time in milliseconds, 0 disables
+ *
+ * Returns:
+ * POSIX OK(0) or non-zero on error, with @errno set.
+ */
+int cond_settle_add(char *pattern, int msec)
+{
+	struct settle_rule *r;
+
+	if (!pattern) {
+		cond_settle = msec;
+		return 0;
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return 1;
+
+	r->pattern = strdup(pattern);
+	if (!r->pattern) {
+		free(r);
+		return 1;
+	}
+	r->msec = msec;
+	TAILQ_INSERT_TAIL(&settle_rules, r, link);
+
+	return 0;
+}
+
+/*
+ * Called on .conf reload, before the new settle rules are read.  The
+ * per-condition state is kept to not lose the suppressed counters.
+ */
+void cond_settle_clear(void)
+{
+	struct settle_rule *r, *tmp;
+
+	TAILQ_FOREACH_SAFE(r, &settle_rules, link, tmp) {
+		TAILQ_REMOVE(&settle_rules, r, link);
+		free(r->pattern);
+		free(r);
+	}
+	cond_settle = 0;
+}
+
+static int settle_msec(const char *name)
+{
+	struct settle_rule *r;
+
+	TAILQ_FOREACH(r, &settle_rules, link) {
+		if (!fnmatch(r->pattern, name, 0))
+			return r->msec;
+	}
+
+	return cond_settle;
+}
+
+static struct settle *settle_find(const char *name, enum cond_state raw)
+{
+	struct settle *s;
+
+	TAILQ_FOREACH(s, &settle_list, link) {
+		if (!strcmp(s->name, name))
+			return s;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->name = strdup(name);
+	if (!s->name) {
+		free(s);
+		return NULL;
+	}
+	s->raw = s->stable = raw;
+	TAILQ_INSERT_TAIL(&settle_list, s, link);
+
+	return s;
+}
+
+/**
+ * cond_get_settled - get debounced state of a condition
+ * @name: condition name
+ *
+ * Like cond_get(), but a change is only reported after it has held for
+ * the settle time of the condition.  Until then the previous stable
+ * state is returned and a timer re-evaluates services when it is due.
+ * Flux is always passed through, it is used during reload.
+ *
+ * Returns:
+ * The settled state of the condition.
+ */
+enum cond_state cond_get_settled(const char *name)
+{
+	enum cond_state raw;
+	struct settle *s;
+	uint64_t now, usec;
+	int msec;
+
+	raw = cond_get(name);
+	if (raw == COND_FLUX)
+		return raw;
+
+	msec = settle_msec(name);
+	if (!msec)
+		return raw;
+
+	s = settle_find(name, raw);
+	if (!s)
+		return raw;
+
+	now = mono_usec();
+	if (raw != s->raw) {
+		if (s->raw != s->stable) {
+			s->suppressed++;
+			_d("%s: suppressed %s -> %s", name, condstr(s->stable), condstr(s->raw));
+		}
+		s->raw = raw;
+		s->changed = now;
+	}
+
+	if (s->raw != s->stable) {
+		usec = (uint64_t)msec * 1000;
+		if (now - s->changed >= usec)
+			s->stable = s->raw;
+		else
+			cond_settle_arm(s->changed + usec);
+	}
+
+	return s->stable;
+}
+
+/*
+ * Same as cond_get_agg() but with settled conditions.
+ */
+enum cond_state cond_get_agg_settled(const char *names)
+{
+	static char conds[MAX_COND_LEN];
+	enum cond_state s = COND_ON;
+	char *cond;
+
+	if (!names)
+		return COND_ON;
+
+	strlcpy(conds, names, sizeof(conds));
+	for (cond = strtok(conds, ","); s && cond; cond = strtok(NULL, ","))
+		s = min(s, cond_get_settled(cond));
+
+	return s;
+}
+
+/**
+ * cond_settle_iterator - iterate over conditions with settle state
+ * @name:       pointer to condition name
+ * @suppressed: pointer to number of suppressed changes
+ * @first:      non-zero to restart iteration
+ *
+ * Returns:
+ * Non-zero while there are records, zero at end of list.
+ */
+int cond_settle_iterator(char **name, uint64_t *suppressed, int first)
+{
+	static struct settle *iter;
+
+	if (first)
+		iter = TAILQ_FIRST(&settle_list);
+	else if (iter)
+		iter = TAILQ_NEXT(iter, link);
+
+	if (!iter)
+		return 0;
+
+	*name = iter->name;
+	*suppressed = iter->suppressed;
+
+	return 1;
 }
 
 static int do_assert(const char *fpath, const struct stat *sb, int tflg, struct FTW *ftw, int set)
@@ -329,7 +646,9 @@ void cond_init(void)
 		return;
 	}
 
-	cond_bump_reconf();
+	/* Keep conditions asserted before initctl reexec */
+	if (!resume)
+		cond_bump_reconf();
 }
 
 /**
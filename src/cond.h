@@ -6,11 +6,13 @@
 #include "svc.h"
 
 #define COND_BASE      "finit/cond"
+#define COND_DEV       "dev/"
 #define COND_PID       "pid/"
 #define COND_SYS       "sys/"
 #define COND_USR       "usr/"
 
 #define _PATH_COND     _PATH_VARRUN COND_BASE "/"
+#define _PATH_CONDDEV  _PATH_COND   COND_DEV
 #define _PATH_CONDPID  _PATH_COND   COND_PID
 #define _PATH_CONDSYS  _PATH_COND   COND_SYS
 #define _PATH_CONDUSR  _PATH_COND   COND_USR
@@ -22,6 +24,22 @@ typedef enum cond_state {
 	COND_ON
 } cond_state_t;
 
+/*
+ * INIT_CMD_COND_DUMP reply, one record per condition.  The owner is
+ * NAME:ID of the service for pid/ conditions, otherwise "init",
+ * "static", or "unknown".  Dependents is a comma separated list of
+ * services with the condition in their <..>, truncated if too long.
+ */
+struct cond_rec {
+	char         name[MAX_ARG_LEN * 2];
+	char         owner[MAX_IDENT_LEN];
+	char         deps[MAX_COND_LEN];
+	int          num_deps;
+	int          state;		/* enum cond_state */
+	unsigned int gen;
+	pid_t        pid;		/* Owner PID, 0: none */
+};
+
 char           *mkcond       (svc_t *svc, char *buf, size_t len);
 const char     *condstr      (enum cond_state s);
 const char     *cond_path    (const char *name);
@@ -42,6 +60,15 @@ int cond_set_noupdate (const char *name);
 int cond_set_oneshot_noupdate(const char *name);
 int cond_clear_noupdate(const char *name);
 
+extern int cond_settle;
+
+int             cond_settle_add      (char *pattern, int msec);
+void            cond_settle_clear    (void);
+void            cond_settle_arm      (uint64_t deadline);
+enum cond_state cond_get_settled     (const char *name);
+enum cond_state cond_get_agg_settled (const char *names);
+int             cond_settle_iterator (char **name, uint64_t *suppressed, int first);
+
 void cond_reassert    (const char *pat);
 void cond_deassert    (const char *pat);
 
@@ -41,8 +41,12 @@
 #include "finit.h"
 #include "cond.h"
 #include "iwatch.h"
+#include "logbuf.h"
+#include "loop.h"
+#include "metrics.h"
 #include "private.h"
 #include "service.h"
+#include "shutdown.h"
 #include "tty.h"
 #include "helpers.h"
 #include "util.h"
@@ -53,6 +57,7 @@
 
 int logfile_size_max = 200000;	/* 200 kB */
 int logfile_count_max = 5;
+int logbuf_size = LOGBUF_SIZE;
 
 struct rlimit initial_rlimit[RLIMIT_NLIMITS];
 struct rlimit global_rlimit[RLIMIT_NLIMITS];
@@ -533,7 +538,7 @@ static void parse_static(char *line, int is_rcsd)
 
 	if (MATCH_CMD(line, "log ", x)) {
 		char *tok;
-		static int size = 200000, count = 5;
+		static int size = 200000, count = 5, buffer = LOGBUF_SIZE;
 
 		tok = strtok(x, ":= ");
 		while (tok) {
@@ -541,6 +546,8 @@ static void parse_static(char *line, int is_rcsd)
 				size = strtobytes(strtok(NULL, ":= "));
 			else if (!strncmp(tok, "count", 5))
 				count = strtobytes(strtok(NULL, ":= "));
+			else if (!strncmp(tok, "buffer", 6))
+				buffer = strtobytes(strtok(NULL, ":= "));
 
 			tok = strtok(NULL, ":= ");
 		}
@@ -549,6 +556,8 @@ static void parse_static(char *line, int is_rcsd)
 			logfile_size_max = size;
 		if (count >= 0)
 			logfile_count_max = count;
+		if (buffer >= 0)
+			logbuf_size = buffer;
 	}
 
 	if (MATCH_CMD(line, "shutdown ", x)) {
@@ -593,6 +602,68 @@ static void parse_static(char *line, int is_rcsd)
 		}
 		return;
 	}
+
+	/*
+	 * Deadline for stopping all services at halt/reboot, seconds
+	 */
+	if (MATCH_CMD(line, "shutdown-timeout ", x)) {
+		char *token = strip_line(x);
+		const char *err = NULL;
+		int val;
+
+		/* 0 (no deadline) to 1 hour */
+		val = strtonum(token, 0, 3600, &err);
+		if (!err)
+			shutdown_timeout = val * 1000; /* to milliseconds */
+		return;
+	}
+
+	/*
+	 * Periodic export of metrics to /run/finit/metrics.prom, seconds
+	 */
+	if (MATCH_CMD(line, "metrics-interval ", x)) {
+		char *token = strip_line(x);
+		const char *err = NULL;
+		int val;
+
+		/* 0 (disabled) to 1 hour */
+		val = strtonum(token, 0, 3600, &err);
+		if (!err)
+			metrics_interval = val * 1000; /* to milliseconds */
+		return;
+	}
+
+	/*
+	 * Condition settle time, msec, optionally for a set of patterns
+	 */
+	if (MATCH_CMD(line, "cond-settle ", x)) {
+		char *token = strip_line(x);
+		const char *err = NULL;
+		char *msec, *pat;
+		int val;
+
+		msec = strtok(token, " \t");
+		if (!msec)
+			return;
+
+		/* 0 (disabled) to 1 minute */
+		val = strtonum(msec, 0, 60000, &err);
+		if (err) {
+			_e("cond-settle %s is %s (0-60000)", msec, err);
+			return;
+		}
+
+		pat = strtok(NULL, " \t");
+		if (!pat) {
+			cond_settle_add(NULL, val);
+			return;
+		}
+
+		do
+			cond_settle_add(pat, val);
+		while ((pat = strtok(NULL, " \t")));
+		return;
+	}
 }
 
 static void parse_dynamic(char *line, struct rlimit rlimit[], char *file)
@@ -715,6 +786,11 @@ int conf_reload(void)
 	/* Mark and sweep */
 	cgroup_mark_all();
 	svc_mark_dynamic();
+	cond_settle_clear();
+
+	/* Global settings back to defaults, in case removed from .conf */
+	shutdown_timeout = SHUTDOWN_TIMEOUT * 1000;
+	metrics_interval = 0;
 
 	/*
 	 * Reset global rlimit to bootstrap values from conf_init().
@@ -797,6 +873,9 @@ done:
 	/* Remove all unused top-level cgroups */
 	cgroup_cleanup();
 
+	/* Start, change, or stop periodic metrics export */
+	metrics_init();
+
 	/* Drop record of all .conf changes */
 	drop_changes();
 
@@ -951,6 +1030,7 @@ static void conf_cb(uev_t *w, void *arg, int events)
 		service_reload_dynamic();
 #endif
 }
+LOOP_PROBE(conf_cb)
 
 /*
  * Set up inotify watcher and load all *.conf in /etc/finit.d/
@@ -1016,7 +1096,7 @@ int conf_init(uev_ctx_t *ctx)
 	if (fd < 0)
 		return 1;
 
-	if (uev_io_init(ctx, &etcw, conf_cb, NULL, fd, UEV_READ)) {
+	if (uev_io_init(ctx, &etcw, LOOP_CB(conf_cb), NULL, fd, UEV_READ)) {
 		_pe("Failed setting up I/O callback for /etc watcher");
 		close(fd);
 		return 1;
@@ -29,6 +29,7 @@
 
 extern int logfile_size_max;
 extern int logfile_count_max;
+extern int logbuf_size;
 
 extern struct rlimit global_rlimit[];
 extern char cgroup_current[];
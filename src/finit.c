@@ -47,8 +47,11 @@
 #include "cond.h"
 #include "conf.h"
 #include "helpers.h"
+#include "keepalive.h"
+#include "loop.h"
 #include "private.h"
 #include "plugin.h"
+#include "reexec.h"
 #include "service.h"
 #include "sig.h"
 #include "sm.h"
@@ -65,6 +68,7 @@ int   debug     = 0;		/* debug mode from kernel cmdline */
 int   rescue    = 0;		/* rescue mode from kernel cmdline */
 int   single    = 0;		/* single user mode from kernel cmdline */
 int   bootstrap = 1;		/* set while bootrapping (for TTYs) */
+int   resume    = 0;		/* set when re-executed by initctl reexec */
 int   kerndebug = 0;		/* set if /proc/sys/kernel/printk > 7 */
 char *sdown     = NULL;
 char *network   = NULL;
@@ -417,10 +421,16 @@ static void finalize(void *unused)
 }
 
 /*
- * Start cranking the big state machine
+ * Start cranking the big state machine, once all async base FS hooks,
+ * e.g., module loading and restoring the RTC, have completed.
  */
-static void crank_worker(void *unused)
+static void crank_worker(void *work)
 {
+	if (plugin_pending(HOOK_BASEFS_UP)) {
+		schedule_work(work);
+		return;
+	}
+
 	/*
 	 * Initialize state machine and start all bootstrap tasks
 	 * NOTE: no network available!
@@ -443,6 +453,12 @@ static void bootstrap_worker(void *work)
 		.delay = 10
 	};
 
+	/* Bootstrap has not started yet, see crank_worker() */
+	if (plugin_pending(HOOK_BASEFS_UP)) {
+		schedule_work(work);
+		return;
+	}
+
 	_d("Step all services ...");
 	service_step_all(SVC_TYPE_ANY);
 
@@ -486,7 +502,7 @@ static int version(int rc)
 
 static int usage(int rc)
 {
-	printf("Usage: %s [OPTIONS] [q | Q | 0-9]\n\n"
+	printf("Usage: %s [OPTIONS] [q | Q | u | U | 0-9]\n\n"
 	       "Options:\n"
 //	       "  -a       Ignored, compat SysV init\n"
 //	       "  -b       Ignored, compat SysV init\n"
@@ -504,6 +520,7 @@ static int usage(int rc)
 	       "  q, Q     Reload /etc/finit.conf and/or any *.conf in /etc/finit.d/\n"
 	       "           if modified, same as initctl reload or SIGHUP to PID 1\n"
 	       "  1, s, S  Enter system rescue mode, runlevel 1\n"
+	       "  u, U     Re-execute Finit, e.g. after upgrade, same as initctl reexec\n"
 	       "\n", prognm);
 
 	return rc;
@@ -546,6 +563,9 @@ static int telinit(int argc, char *argv[])
 
 		if (req == 's' || req == 'S')
 			return systemf("initctl -b runlevel %c", req);
+
+		if (req == 'u' || req == 'U')
+			return systemf("initctl -b reexec");
 	}
 
 	/* XXX: add non-pid1 process monitor here
@@ -567,12 +587,17 @@ int main(int argc, char *argv[])
 		.cb = bootstrap_worker,
 		.delay = 100
 	};
-	uev_ctx_t loop;
 
 	/* telinit or stand-alone process monitor */
 	if (getpid() != 1)
 		return telinit(argc, argv);
 
+	/*
+	 * Re-executed by initctl reexec?  Then everything is already
+	 * mounted and all services are running, skip bootstrap.
+	 */
+	resume = reexec_init(argv);
+
 	/*
 	 * Need /dev, /proc, and /sys for console=, remount and cgroups
 	 */
@@ -590,10 +615,20 @@ int main(int argc, char *argv[])
 	console_init();
 
 	/*
-	 * Initialize event context.
+	 * Initialize event contexts, one per priority class.
+	 */
+	loop_create();
+	ctx = loop_ctx(LOOP_PRIO_MAIN);
+
+	/*
+	 * Console progress is drained by the event loop from now on
+	 */
+	console_async(ctx);
+
+	/*
+	 * Watch for syslogd to create /dev/log, replays early log
 	 */
-	uev_init1(&loop, 1);
-	ctx = &loop;
+	log_monitor();
 
 	/*
 	 * Set PATH, SHELL, and PWD early to something sane
@@ -609,7 +644,7 @@ int main(int argc, char *argv[])
 	/*
 	 * In case of emergency.
 	 */
-	if (rescue) {
+	if (rescue && !resume) {
 		char *sulogin[] = {
 			_PATH_SULOGIN,
 			"sulogin",
@@ -629,31 +664,39 @@ int main(int argc, char *argv[])
 	 * Load plugins early, the first hook is in banner(), so we
 	 * need plugins loaded before calling it.
 	 */
-	plugin_init(&loop);
+	plugin_init(loop_ctx(LOOP_PRIO_COND));
 
 	/*
 	 * Hello world.
 	 */
-	enable_progress(1);	/* Allow progress, if enabled */
-	banner();
-
-	if (osheading)
-		logit(LOG_CONSOLE | LOG_NOTICE, "%s, entering runlevel S", osheading);
-	else
-		logit(LOG_CONSOLE | LOG_NOTICE, "Entering runlevel S");
+	if (!resume) {
+		enable_progress(1);	/* Allow progress, if enabled */
+		banner();
+
+		if (osheading)
+			logit(LOG_CONSOLE | LOG_NOTICE, "%s, entering runlevel S", osheading);
+		else
+			logit(LOG_CONSOLE | LOG_NOTICE, "Entering runlevel S");
+	}
 
 	/*
 	 * Initial setup of signals, ignore all until we're up.
 	 */
 	sig_init();
 
+	/*
+	 * Time callbacks and hooks, catch anyone stalling the event loop
+	 */
+	loop_init();
+
 	/*
 	 * Initialize default control groups, if available
 	 */
-	cgroup_init(&loop);
+	cgroup_init(loop_ctx(LOOP_PRIO_COND));
 
 	/* Check and mount filesystems. */
-	fs_mount_all();
+	if (!resume)
+		fs_mount_all();
 
 	/* Bootstrap conditions, needed for hooks */
 	cond_init();
@@ -668,7 +711,7 @@ int main(int argc, char *argv[])
 	/*
 	 * Initialize .conf system and load static /etc/finit.conf.
 	 */
-	conf_init(&loop);
+	conf_init(loop_ctx(LOOP_PRIO_COND));
 
 	/*
 	 * Start built-in watchdogd as soon as possible, if enabled
@@ -685,10 +728,12 @@ int main(int argc, char *argv[])
 		service_register(SVC_TYPE_SERVICE, "[123456789] cgroup.init " FINIT_LIBPATH_ "/keventd -- Finit kernel event daemon", global_rlimit, NULL);
 
 	/* Base FS up, enable standard SysV init signals */
-	sig_setup(&loop);
+	sig_setup(loop_ctx(LOOP_PRIO_SIG));
 
-	_d("Base FS up, calling hooks ...");
-	plugin_run_hooks(HOOK_BASEFS_UP);
+	if (!resume) {
+		_d("Base FS up, calling hooks ...");
+		plugin_run_hooks(HOOK_BASEFS_UP);
+	}
 
 	/*
 	 * Set up inotify watcher for /etc/finit.conf, /etc/finit.d, and
@@ -697,13 +742,19 @@ int main(int argc, char *argv[])
 	conf_monitor();
 
 	_d("Starting initctl API responder ...");
-	api_init(&loop);
-
-	_d("Starting the big state machine ...");
-	schedule_work(&crank_work);
-
-	_d("Starting bootstrap finalize timer ...");
-	schedule_work(&bootstrap_work);
+	api_init(loop_ctx(LOOP_PRIO_API));
+	keepalive_init(ctx);
+
+	if (resume) {
+		_d("Taking over services from previous Finit ...");
+		reexec_restore();
+	} else {
+		_d("Starting the big state machine ...");
+		schedule_work(&crank_work);
+
+		_d("Starting bootstrap finalize timer ...");
+		schedule_work(&bootstrap_work);
+	}
 
 	/*
 	 * Background service tasks
@@ -711,10 +762,11 @@ int main(int argc, char *argv[])
 	service_init();
 
 	/*
-	 * Enter main loop to monitor /dev/initctl and services
+	 * Enter main loop to monitor /dev/initctl and services, serving
+	 * signals, condition sources, timers, and API in that order.
 	 */
 	_d("Entering main loop ...");
-	return uev_run(&loop, 0);
+	return loop_run();
 }
 
 /**
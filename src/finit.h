@@ -95,6 +95,12 @@
 #define INIT_CMD_SVC_QUERY      130
 #define INIT_CMD_SVC_FIND       131
 #define INIT_CMD_SVC_FIND_BYC   132
+#define INIT_CMD_LOOP_STATS     133  /* Event loop callback statistics */
+#define INIT_CMD_SVC_MATCH      134  /* Services matching struct svc_match */
+#define INIT_CMD_COND_DUMP      135  /* All conditions, see struct cond_rec */
+#define INIT_CMD_SVC_LOG        136  /* Service log buffer, see logbuf.h */
+#define INIT_CMD_SVC_WAIT       137  /* Wait for services, see below */
+#define INIT_CMD_REEXEC         138  /* Re-execute PID 1, services keep running */
 #define INIT_CMD_NACK           254
 #define INIT_CMD_ACK            255
 
@@ -107,11 +113,39 @@ struct init_request {
 	char	data[368];
 };
 
+/*
+ * INIT_CMD_SVC_MATCH query, sent in init_request.data.  The reply is
+ * one svc_t per match followed by the request, with runlevel set to
+ * the number of matches and sleeptime to the number of idents equal
+ * to pattern, ignoring case.
+ */
+#define SVC_MATCH_EXACT  0x00	/* NAME, NAME:ID, JOB, or JOB:ID */
+#define SVC_MATCH_GLOB   0x01	/* fnmatch(3) on NAME:ID */
+#define SVC_MATCH_REGEX  0x02	/* Extended regex on NAME:ID */
+#define SVC_MATCH_MODE   0x0f
+#define SVC_MATCH_COUNT  0x10	/* Only count matches, no records */
+
+struct svc_match {
+	int	type;		/* Mask of SVC_TYPE_*, 0: any	*/
+	int	state;		/* Mask of 1 << state, 0: any	*/
+	int	flags;		/* SVC_MATCH_*			*/
+	char	pattern[356];	/* Empty pattern matches all	*/
+};
+
+/*
+ * Waiting for services: with sleeptime > 0 the reply to a start, stop,
+ * restart, or reload command is held back for at most sleeptime sec,
+ * until all services are running and ready (PID condition asserted),
+ * or stopped.  INIT_CMD_SVC_WAIT only waits, for the command given in
+ * runlevel.  On failure, or timeout, the NACK holds a reason in data.
+ */
+
 extern int    runlevel;
 extern int    cfglevel;
 extern int    prevlevel;
 extern int    debug;
 extern int    rescue;
+extern int    resume;
 extern int    single;
 extern int    bootstrap;
 extern int    kerndebug;
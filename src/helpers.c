@@ -39,6 +39,7 @@
 
 #include "finit.h"
 #include "helpers.h"
+#include "loop.h"
 #include "private.h"
 #include "util.h"
 #include "utmp-api.h"
@@ -46,6 +47,26 @@
 static pstyle_t progress_onoff = PROGRESS_DEFAULT;
 static pstyle_t progress_style = PROGRESS_DEFAULT;
 
+/*
+ * Once the event loop is up, console output from PID 1 is written to a
+ * non-blocking descriptor of the console.  What the console cannot take
+ * right away is buffered and drained by the event loop, so boot time no
+ * longer depends on the console baud rate.  When the buffer is full,
+ * whole lines are dropped and later replaced with a marker.
+ */
+#define CONSOLE_BUFSZ 8192
+
+static struct {
+	char   buf[CONSOLE_BUFSZ];
+	size_t head;			/* Next byte to write */
+	size_t len;			/* Bytes buffered */
+	int    dropping;		/* Dropping until end of line */
+	int    dropped;			/* Lines dropped, for marker */
+	int    fd;
+	pid_t  pid;			/* Forked children write directly */
+	uev_t  watcher;
+} con = { .fd = -1 };
+
 #ifndef HOSTNAME_PATH
 #define HOSTNAME_PATH "/etc/hostname"
 #endif
@@ -82,6 +103,163 @@ void console_init(void)
 	ttinit();
 }
 
+static void con_push(const char *s, size_t len)
+{
+	size_t tail, num;
+
+	while (len) {
+		tail = (con.head + con.len) % CONSOLE_BUFSZ;
+		num  = min(len, CONSOLE_BUFSZ - tail);
+		memcpy(&con.buf[tail], s, num);
+		con.len += num;
+		s       += num;
+		len     -= num;
+	}
+}
+
+/* Write as much as the console takes, on error the buffer is discarded */
+static void con_drain(void)
+{
+	ssize_t num;
+
+	while (con.len) {
+		num = write(con.fd, &con.buf[con.head], min(con.len, CONSOLE_BUFSZ - con.head));
+		if (num <= 0) {
+			if (num == -1 && errno == EINTR)
+				continue;
+			if (num == -1 && errno == EAGAIN)
+				return;
+			break;
+		}
+
+		con.head = (con.head + num) % CONSOLE_BUFSZ;
+		con.len -= num;
+	}
+
+	con.head = con.len = 0;
+}
+
+/* Queue marker for dropped lines, returns non-zero if no room yet */
+static int con_marker(void)
+{
+	char buf[64];
+	int len;
+
+	if (!con.dropped)
+		return 0;
+
+	len = snprintf(buf, sizeof(buf), "\r\e[K*** %d console line(s) dropped ***\n", con.dropped);
+	if (CONSOLE_BUFSZ - con.len < (size_t)len)
+		return 1;
+
+	con_push(buf, len);
+	con.dropped = 0;
+
+	return 0;
+}
+
+/* The watcher is active as long as there is something buffered */
+static void con_arm(size_t was)
+{
+	if (!was && con.len)
+		uev_io_start(&con.watcher);
+	else if (was && !con.len)
+		uev_io_stop(&con.watcher);
+}
+
+static void con_write(const char *s, size_t len)
+{
+	size_t was = con.len;
+
+	if (con.dropping || con_marker() || CONSOLE_BUFSZ - con.len < len) {
+		con.dropping = !memchr(s, '\n', len);
+		if (!con.dropping)
+			con.dropped++;
+		return;
+	}
+
+	con_push(s, len);
+	con_drain();
+	con_arm(was);
+}
+
+static void console_cb(uev_t *w, void *arg, int events)
+{
+	size_t was = con.len;
+
+	if (UEV_ERROR == events) {
+		_e("Console error, restarting watcher.");
+		uev_io_start(w);
+		return;
+	}
+
+	con_drain();
+	if (!con_marker())
+		con_drain();
+	con_arm(was);
+}
+LOOP_PROBE(console_cb)
+
+/*
+ * Called when the event loop is set up.  The console is reopened, not
+ * dup'ed, since O_NONBLOCK is shared with all processes inheriting our
+ * stderr.  On failure console output remains synchronous.
+ */
+int console_async(uev_ctx_t *ctx)
+{
+	int fd;
+
+	fd = open("/proc/self/fd/2", O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1) {
+		_pe("Failed opening console for asynchronous output");
+		return -1;
+	}
+
+	if (uev_io_init(ctx, &con.watcher, LOOP_CB(console_cb), NULL, fd, UEV_WRITE)) {
+		_pe("Failed setting up console watcher");
+		close(fd);
+		return -1;
+	}
+	uev_io_stop(&con.watcher);
+
+	con.fd  = fd;
+	con.pid = getpid();
+
+	return 0;
+}
+
+/*
+ * Write all buffered console output, blocking.  Used when the event
+ * loop will not run again, before shutdown and re-exec.
+ */
+void console_flush(void)
+{
+	size_t was = con.len;
+	int flags;
+
+	if (con.fd == -1 || getpid() != con.pid)
+		return;
+
+	flags = fcntl(con.fd, F_GETFL);
+	fcntl(con.fd, F_SETFL, flags & ~O_NONBLOCK);
+	con_drain();
+	if (!con_marker())
+		con_drain();
+	fcntl(con.fd, F_SETFL, flags);
+	con_arm(was);
+}
+
+/* Flush and go back to synchronous console output */
+void console_exit(void)
+{
+	if (con.fd == -1)
+		return;
+
+	console_flush();
+	close(con.fd);
+	con.fd = -1;
+}
+
 ssize_t cprintf(const char *fmt, ...)
 {
 	const size_t len = strlen(fmt) * 2;
@@ -93,7 +271,13 @@ ssize_t cprintf(const char *fmt, ...)
 	size = vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
 
-	dprint(STDERR_FILENO, buf, size);
+	if (size >= sizeof(buf))
+		size = sizeof(buf) - 1;
+
+	if (con.fd != -1 && getpid() == con.pid)
+		con_write(buf, size);
+	else
+		dprint(STDERR_FILENO, buf, size);
 
 	return size;
 }
@@ -303,7 +487,7 @@ void printv(const char *fmt, va_list ap)
 	if (!fmt || progress_style == PROGRESS_SILENT)
 		return;
 
-	delline();
+	cprintf("\e[2K");	/* delline(), but in order with the rest */
 
 	buf[0] = 0;
 	len = print_timestamp(buf, sizeof(buf));
@@ -24,9 +24,9 @@
 #include "config.h"
 
 #include <err.h>
-#include <ftw.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <paths.h>
 #include <signal.h>
 #include <stdio.h>
@@ -41,6 +41,8 @@
 
 #include "client.h"
 #include "cond.h"
+#include "logbuf.h"
+#include "loop.h"
 #include "serv.h"
 #include "service.h"
 #include "cgutil.h"
@@ -56,6 +58,8 @@ struct cmd {
 
 int icreate  = 0;
 int iforce   = 0;
+int ifollow  = 0;
+int iwait    = 0;
 int ionce    = 0;
 int debug    = 0;
 int heading  = 1;
@@ -71,17 +75,26 @@ int iw, pw;
 extern int reboot_main(int argc, char *argv[]);
 
 
+/* all services, in one request */
+static svc_t *svc_list(int *num)
+{
+	struct svc_match m = { 0 };
+
+	return client_svc_match(&m, num, NULL);
+}
+
 /* figure ut width of IDENT and PID columns */
-static void col_widths(void)
+static void col_widths(svc_t *list, int num)
 {
 	char ident[MAX_IDENT_LEN];
 	char pid[10];
-	svc_t *svc;
+	int i;
 
 	iw = 0;
 	pw = 0;
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
+		svc_t *svc = &list[i];
 		int w, p;
 
 		svc_ident(svc, ident, sizeof(ident));
@@ -143,6 +156,39 @@ static int runlevel_get(int *prevlevel)
 	return rc;
 }
 
+static int show_probe(void *rec, void *arg)
+{
+	struct probe *p = (struct probe *)rec;
+	uint64_t avg = p->calls ? p->total / p->calls : 0;
+	int i;
+
+	printf("%-24.24s %8" PRIu64 " %9" PRIu64 " %9" PRIu64, p->name, p->calls, avg, p->max);
+	for (i = 0; i < LOOP_HIST_MAX; i++)
+		printf(" %6" PRIu64, p->hist[i]);
+	puts("");
+
+	return 0;
+}
+
+/*
+ * Latency of event loop callbacks and plugin hooks, in microseconds,
+ * with a histogram of number of calls per decade.
+ */
+static int show_loop(void)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd = INIT_CMD_LOOP_STATS,
+	};
+
+	if (heading)
+		print_header("%-24s %8s %9s %9s %6s %6s %6s %6s %6s %6s %6s %6s",
+			     "CALLBACK", "CALLS", "AVG(us)", "MAX(us)", "<10us", "<100us",
+			     "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s");
+
+	return client_recv(&rq, sizeof(struct probe), show_probe, NULL);
+}
+
 static int toggle_debug(char *arg)
 {
 	struct init_request rq = {
@@ -150,10 +196,13 @@ static int toggle_debug(char *arg)
 		.cmd = INIT_CMD_DEBUG,
 	};
 
+	if (arg && !strcmp(arg, "loop"))
+		return show_loop();
+
 	return client_send(&rq, sizeof(rq));
 }
 
-static int do_log(char *svc)
+static int grep_log(char *svc)
 {
 	char *logfile = "/var/log/syslog";
 
@@ -166,6 +215,108 @@ static int do_log(char *svc)
 	return systemf("cat %s | grep %s | tail -10", logfile, svc);
 }
 
+struct log_out {
+	uint64_t offset;
+	char    *buf;
+	size_t   len;
+};
+
+static int log_append(void *rec, void *arg)
+{
+	struct logbuf_rec *r = (struct logbuf_rec *)rec;
+	struct log_out *o = (struct log_out *)arg;
+	char *buf;
+
+	if (r->len > sizeof(r->data))
+		return 1;
+
+	buf = realloc(o->buf, o->len + r->len + 1);
+	if (!buf)
+		return 1;
+
+	memcpy(&buf[o->len], r->data, r->len);
+	o->len += r->len;
+	buf[o->len] = 0;
+	o->buf = buf;
+	o->offset = r->offset + r->len;
+
+	return 0;
+}
+
+static int read_logbuf(char *ident, struct log_out *o)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_SVC_LOG,
+	};
+	struct logbuf_req *req = (struct logbuf_req *)rq.data;
+
+	req->offset = o->offset;
+	strlcpy(req->ident, ident, sizeof(req->ident));
+	o->len = 0;
+
+	return client_recv(&rq, sizeof(struct logbuf_rec), log_append, o);
+}
+
+/*
+ * Show the last @lines lines, or all, kept in a service's log buffer,
+ * and optionally keep polling for more, like tail -f.
+ */
+static int show_logbuf(char *ident, int lines, int follow)
+{
+	struct log_out o = { 0 };
+	char *ptr;
+	int rc;
+
+	rc = read_logbuf(ident, &o);
+	if (rc) {
+		free(o.buf);
+		return rc;
+	}
+
+	ptr = o.buf;
+	if (ptr && lines > 0) {
+		char *end = &o.buf[o.len];
+
+		/* Skip trailing newline */
+		if (end > o.buf && end[-1] == '\n')
+			end--;
+		while (end > o.buf) {
+			if (*--end == '\n' && --lines == 0) {
+				end++;
+				break;
+			}
+		}
+		ptr = end;
+	}
+	if (ptr)
+		fputs(ptr, stdout);
+
+	while (follow) {
+		fflush(stdout);
+		usleep(250000);
+
+		if (read_logbuf(ident, &o))
+			break;
+		if (o.len)
+			fwrite(o.buf, 1, o.len, stdout);
+	}
+	free(o.buf);
+
+	return 0;
+}
+
+/*
+ * Prefer the service's log buffer in Finit, fall back to syslog
+ */
+static int do_log(char *svc)
+{
+	if (svc && svc[0] && !show_logbuf(svc, 0, ifollow))
+		return 0;
+
+	return grep_log(svc);
+}
+
 static int do_runlevel(char *arg)
 {
 	struct init_request rq = {
@@ -217,7 +368,7 @@ static int do_svc(int cmd, char *arg)
  * the service(s) provided as argument.  If a service does not exist
  * we make sure to return an error code.
  */
-static int do_startstop(int cmd, char *arg)
+static int do_startstop(int cmd, char *arg, int wait)
 {
 	struct init_request rq = {
 		.magic = INIT_MAGIC,
@@ -240,94 +391,305 @@ static int do_startstop(int cmd, char *arg)
 		return 1;
 	}
 
-	return do_svc(cmd, arg);
+	/* With @wait, Finit replies when done, or with the reason why not */
+	rq.cmd       = cmd;
+	rq.sleeptime = wait;
+	strlcpy(rq.data, arg, sizeof(rq.data));
+	if (client_send(&rq, sizeof(rq))) {
+		if (wait && rq.cmd == INIT_CMD_NACK)
+			warnx("%s", rq.data);
+		return 1;
+	}
+
+	return 0;
 }
 
-static int do_start  (char *arg) { return do_startstop(INIT_CMD_START_SVC,   arg); }
-static int do_stop   (char *arg) { return do_startstop(INIT_CMD_STOP_SVC,    arg); }
+static int do_start  (char *arg) { return do_startstop(INIT_CMD_START_SVC, arg, iwait); }
+static int do_stop   (char *arg) { return do_startstop(INIT_CMD_STOP_SVC,  arg, iwait); }
 
 static int do_reload (char *arg)
 {
 	if (!arg || !arg[0])
 		return do_svc(INIT_CMD_RELOAD, NULL);
 
-	return do_startstop(INIT_CMD_RELOAD_SVC, arg);
+	return do_startstop(INIT_CMD_RELOAD_SVC, arg, iwait);
 }
 
-static int do_restart(char *arg)
+static int do_reexec (char *arg)
 {
-	size_t retries = 3;
-	svc_t *svc;
+	return do_svc(INIT_CMD_REEXEC, NULL);
+}
 
-	if (do_startstop(INIT_CMD_STOP_SVC, arg))
+static int do_restart(char *arg)
+{
+	/* Finit replies when all have stopped, or after 3 sec */
+	if (do_startstop(INIT_CMD_STOP_SVC, arg, 3))
 		return 1;
 
-	while (retries-- > 0 && (svc = client_svc_find(arg))) {
-		if (!svc_is_running(svc))
+	return do_startstop(INIT_CMD_RESTART_SVC, arg, iwait);
+}
+
+/*
+ * initctl batch reads commands from stdin, one per line, and sends
+ * them in a few pipelined phases on the same connection.  A restart
+ * is a stop, a wait for all stopped, and then the restart.
+ */
+enum {
+	BATCH_QUERY,
+	BATCH_ACTION,
+	BATCH_STOPPED,
+	BATCH_RESTART,
+	BATCH_WAIT,
+};
+
+struct batch {
+	int         line;
+	int         cmd;		/* 0: only query, or failed */
+	const char *verb;
+	char        arg[368];		/* Size of init_request.data */
+};
+
+static const struct {
+	const char *verb;
+	int         cmd;
+} batch_verbs[] = {
+	{ "query",   0                    },
+	{ "start",   INIT_CMD_START_SVC   },
+	{ "stop",    INIT_CMD_STOP_SVC    },
+	{ "reload",  INIT_CMD_RELOAD_SVC  },
+	{ "restart", INIT_CMD_RESTART_SVC },
+};
+
+/* Request for line in this phase, returns 0 if nothing to send */
+static int batch_rq(struct batch *b, int phase, struct init_request *rq)
+{
+	int restart = b->cmd == INIT_CMD_RESTART_SVC;
+
+	switch (phase) {
+	case BATCH_QUERY:
+		rq->cmd = INIT_CMD_SVC_QUERY;
+		break;
+
+	case BATCH_ACTION:
+		if (!b->cmd)
+			return 0;
+		rq->cmd = restart ? INIT_CMD_STOP_SVC : b->cmd;
+		break;
+
+	case BATCH_STOPPED:
+		if (!restart)
+			return 0;
+		rq->cmd       = INIT_CMD_SVC_WAIT;
+		rq->runlevel  = INIT_CMD_STOP_SVC;
+		rq->sleeptime = 3;
+		break;
+
+	case BATCH_RESTART:
+		if (!restart)
+			return 0;
+		rq->cmd = b->cmd;
+		break;
+
+	case BATCH_WAIT:
+		if (!b->cmd || !iwait)
+			return 0;
+		rq->cmd       = INIT_CMD_SVC_WAIT;
+		rq->runlevel  = b->cmd;
+		rq->sleeptime = iwait;
+		break;
+	}
+
+	rq->magic = INIT_MAGIC;
+	strlcpy(rq->data, b->arg, sizeof(rq->data));
+
+	return 1;
+}
+
+/* Send one request per line in this phase, lines NACKed are dropped */
+static int batch_send(struct batch *b, size_t num, int phase)
+{
+	struct init_request *rq;
+	size_t *idx, i, n = 0;
+	int rc = 0;
+
+	rq  = calloc(num, sizeof(*rq));
+	idx = calloc(num, sizeof(*idx));
+	if (!rq || !idx)
+		err(1, "Failed allocating batch");
+
+	for (i = 0; i < num; i++) {
+		if (batch_rq(&b[i], phase, &rq[n]))
+			idx[n++] = i;
+	}
+
+	if (n && client_pipeline(rq, n) < 0)
+		rc = -1;
+
+	for (i = 0; rc != -1 && i < n; i++) {
+		struct batch *e = &b[idx[i]];
+
+		if (rq[i].cmd != INIT_CMD_NACK)
+			continue;
+
+		switch (phase) {
+		case BATCH_QUERY:
+			warnx("line %d: no such task or service(s): %s", e->line, e->arg);
 			break;
 
-		sleep(1);
+		case BATCH_STOPPED:
+		case BATCH_WAIT:
+			warnx("line %d: %s", e->line, rq[i].data);
+			break;
+
+		default:
+			warnx("line %d: failed %s %s", e->line, e->verb, e->arg);
+			break;
+		}
+		e->cmd = 0;
+		rc = 1;
 	}
 
-	if (retries == 0)
-		errx(1, "Failed stopping %s (restart)", arg);
+	free(idx);
+	free(rq);
 
-	return do_startstop(INIT_CMD_RESTART_SVC, arg);
+	return rc;
 }
 
-static int dump_one_cond(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
+static int do_batch(char *arg)
 {
-	const char *cond, *asserted;
-	char *nm = "init";
-	pid_t pid = 1;
+	struct batch *b = NULL;
+	size_t i, num = 0;
+	char buf[512];
+	int line = 0;
+	int rc = 0;
+	int phase;
 
-	if (tflag != FTW_F)
-		return 0;
+	(void)arg;
+	while (fgets(buf, sizeof(buf), stdin)) {
+		char *verb, *args;
 
-	if (!strcmp(fpath, _PATH_RECONF))
-		return 0;
+		line++;
+		verb = strtok(buf, " \t\n");
+		if (!verb || verb[0] == '#')
+			continue;
 
-	asserted = condstr(cond_get_path(fpath));
-	cond = &fpath[strlen(_PATH_COND)];
-	if (strncmp("pid/", cond, 4) == 0) {
-		svc_t *svc;
+		for (i = 0; i < NELEMS(batch_verbs); i++) {
+			if (!strcmp(batch_verbs[i].verb, verb))
+				break;
+		}
+		if (i == NELEMS(batch_verbs)) {
+			warnx("line %d: unknown command %s", line, verb);
+			rc = 1;
+			continue;
+		}
 
-		svc = client_svc_find_by_cond(cond);
-		if (!svc) {
-			nm  = "unknown";
-			pid = 0;
-		} else {
-			nm  = svc_ident(svc, NULL, 0);
-			pid = svc->pid;
+		args = strtok(NULL, "\n");
+		if (!args || !args[strspn(args, " \t")]) {
+			warnx("line %d: missing argument to %s", line, verb);
+			rc = 1;
+			continue;
 		}
-	} else if (strncmp("usr/", cond, 4) == 0) {
-		nm  = "static";
-		pid = 0;
-	} else if (strncmp("hook/", cond, 4) == 0) {
-		nm  = "static";
-		pid = 1;
+
+		b = realloc(b, (num + 1) * sizeof(*b));
+		if (!b)
+			err(1, "Failed allocating batch");
+
+		b[num].line = line;
+		b[num].cmd  = batch_verbs[i].cmd;
+		b[num].verb = batch_verbs[i].verb;
+		strlcpy(b[num].arg, args, sizeof(b[num].arg));
+		num++;
 	}
 
-	printf("%-*d  %-*s  %-6s  <%s>\n", pw, pid, iw, nm, asserted, cond);
+	if (!num)
+		return rc;
+
+	/* Failed lines are dropped, the rest continue to the next phase */
+	for (phase = BATCH_QUERY; phase <= BATCH_WAIT; phase++) {
+		int result;
+
+		result = batch_send(b, num, phase);
+		if (result)
+			rc = 1;
+		if (result < 0)
+			break;
+	}
+	free(b);
+
+	return rc;
+}
+
+struct cond_list {
+	struct cond_rec *list;
+	int              num;
+};
+
+static int cond_append(void *rec, void *arg)
+{
+	struct cond_list *l = (struct cond_list *)arg;
+	struct cond_rec *list;
+
+	list = realloc(l->list, (l->num + 1) * sizeof(*list));
+	if (!list)
+		return 1;
+
+	memcpy(&list[l->num++], rec, sizeof(*list));
+	l->list = list;
 
 	return 0;
 }
 
+/*
+ * All conditions, with owner and dependents, in one request.  We
+ * collect them first to calculate column widths.
+ */
 static int do_cond_dump(char *arg)
 {
-	col_widths();
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_COND_DUMP,
+	};
+	struct cond_list l = { 0 };
+	char pid[10];
+	int i;
+
+	if (client_recv(&rq, sizeof(struct cond_rec), cond_append, &l)) {
+		warnx("Failed reading conditions from Finit");
+		free(l.list);
+		return 1;
+	}
+
+	iw = 5;
+	pw = 3;
+	for (i = 0; i < l.num; i++) {
+		int w;
+
+		w = (int)strlen(l.list[i].owner);
+		if (w > iw)
+			iw = w;
+
+		w = snprintf(pid, sizeof(pid), "%d", l.list[i].pid);
+		if (w > pw)
+			pw = w;
+	}
+
 	if (heading) {
 		char title[80];
 
 		snprintf(title, sizeof(title), "%-*s  %-*s  %-6s  %s", pw, "PID",
-			 iw, "IDENT", "STATUS", "CONDITION");
+			 iw, "IDENT", "STATUS", verbose ? "CONDITION  GEN  DEPENDENTS" : "CONDITION");
 		print_header(title);
 	}
 
-	if (nftw(_PATH_COND, dump_one_cond, 20, 0) == -1) {
-		warnx("Failed parsing %s", _PATH_COND);
-		return 1;
+	for (i = 0; i < l.num; i++) {
+		struct cond_rec *c = &l.list[i];
+
+		printf("%-*d  %-*s  %-6s  <%s>", pw, c->pid, iw, c->owner, condstr(c->state), c->name);
+		if (verbose)
+			printf("  %u  %s", c->gen, c->num_deps ? c->deps : "-");
+		puts("");
 	}
+	free(l.list);
 
 	return 0;
 }
@@ -417,10 +779,12 @@ static char *svc_cond(svc_t *svc, char *buf, size_t len)
 static int do_cond_show(char *arg)
 {
 	enum cond_state cond;
+	svc_t *list, *svc;
 	char buf[512];
-	svc_t *svc;
+	int i, num;
 
-	col_widths();
+	list = svc_list(&num);
+	col_widths(list, num);
 	if (heading) {
 		char title[80];
 
@@ -429,7 +793,8 @@ static int do_cond_show(char *arg)
 		print_header(title);
 	}
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
+		svc = &list[i];
 		if (!svc->cond[0])
 			continue;
 
@@ -445,6 +810,7 @@ static int do_cond_show(char *arg)
 
 		puts(svc_cond(svc, buf, sizeof(buf)));
 	}
+	free(list);
 
 	return 0;
 }
@@ -705,81 +1071,112 @@ static void show_cgroup_tree(char *group, char *pfx)
 	cgroup_tree(path, pfx, 0, 0);
 }
 
+static int show_svc(svc_t *svc)
+{
+	char ident[MAX_IDENT_LEN];
+	char uptm[42] = "N/A";
+	long now = jiffies();
+	char *pidfn = NULL;
+	char buf[512];
+
+	if (quiet)
+		return svc->state != SVC_RUNNING_STATE;
+
+	pidfn = svc->pidfile;
+	if (pidfn[0] == '!')
+		pidfn++;
+	else if (pidfn[0] == 0)
+		pidfn = "none";
+
+	printf("     Status : %s\n", status(svc, 1));
+	printf("   Identity : %s\n", svc_ident(svc, ident, sizeof(ident)));
+	printf("Description : %s\n", svc->desc);
+	printf("     Origin : %s\n", svc->file[0] ? svc->file : "built-in");
+	printf("Environment : %s\n", svc_environ(svc, buf, sizeof(buf)));
+	printf("Condition(s): %s\n", svc_cond(svc, buf, sizeof(buf)));
+	printf("    Command : %s\n", svc_command(svc, buf, sizeof(buf)));
+	printf("   PID file : %s\n", pidfn);
+	printf("        PID : %d\n", svc->pid);
+	printf("       User : %s\n", svc->username);
+	printf("      Group : %s\n", svc->group);
+	printf("     Uptime : %s\n", svc->pid ? uptime(now - svc->start_time, uptm, sizeof(uptm)) : uptm);
+	printf("   Restarts : %d (%d/%d)\n", svc->restart_tot, svc->restart_cnt, svc->restart_max);
+	if (svc->wdog) {
+		printf("   Watchdog : %d sec, %d restarts, ", svc->wdog, svc->wdog_cnt);
+		if (svc->wdog_ping)
+			printf("last ping %.1f sec ago\n", (mono_usec() - svc->wdog_ping) / 1000000.0);
+		else
+			printf("not armed\n");
+	}
+	printf("  Runlevels : %s\n", runlevel_string(runlevel, svc->runlevels));
+	if (cgrp && svc->pid > 1) {
+		char grbuf[128];
+		char path[256];
+		struct cg *cg;
+		char *group;
+
+		group = pid_cgroup(svc->pid, grbuf, sizeof(grbuf));
+		snprintf(path, sizeof(path), "%s/%s", FINIT_CGPATH, group);
+		cg = cg_conf(path);
+
+		printf("     Memory : %s\n", memsz(cgroup_memory(group), uptm, sizeof(uptm)));
+		printf("     CGroup : %s cpu %s [%s, %s] mem [%s, %s]\n",
+		       group, cg->cg_cpu.set, cg->cg_cpu.weight, cg->cg_cpu.max,
+		       cg->cg_mem.min, cg->cg_mem.max);
+		show_cgroup_tree(group, "              ");
+	}
+	printf("\n");
+
+	if (!show_logbuf(ident, 10, 0))
+		return 0;
+
+	return grep_log(svc->cmd);
+}
+
+/*
+ * One request to Finit, which only replies with the matching services.
+ * A NAME with multiple instances, or a glob pattern, shows a summary of
+ * all matches, otherwise the detailed status is shown.
+ */
 static int show_status(char *arg)
 {
 	char ident[MAX_IDENT_LEN];
+	struct svc_match m = { 0 };
+	svc_t *list, *svc;
+	int num, exact;
 	char buf[512];
-	int num = 0;
-	svc_t *svc;
+	int i, rc;
 
 	runlevel = runlevel_get(NULL);
 
-	while (arg && arg[0]) {
-		long now = jiffies();
-		char uptm[42] = "N/A";
-		char *pidfn = NULL;
-		int exact = 0;
-
-		for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
-			svc_ident(svc, ident, sizeof(ident));
-			if (string_compare(ident, arg))
-				num++;
-			if (string_case_compare(ident, arg))
-				exact++;
-		}
-
-		if (num > 1 && !exact)
-			break;
+	if (arg && arg[0]) {
+		strlcpy(m.pattern, arg, sizeof(m.pattern));
+		if (strpbrk(arg, "*?["))
+			m.flags = SVC_MATCH_GLOB;
+	}
 
-		svc = client_svc_find(arg);
-		if (!svc)
+	list = client_svc_match(&m, &num, &exact);
+	if (m.pattern[0] && m.flags == SVC_MATCH_EXACT) {
+		if (!list)
 			return 255;
-
-		if (quiet)
-			return svc->state != SVC_RUNNING_STATE;
-
-		pidfn = svc->pidfile;
-		if (pidfn[0] == '!')
-			pidfn++;
-		else if (pidfn[0] == 0)
-			pidfn = "none";
-
-		printf("     Status : %s\n", status(svc, 1));
-		printf("   Identity : %s\n", svc_ident(svc, ident, sizeof(ident)));
-		printf("Description : %s\n", svc->desc);
-		printf("     Origin : %s\n", svc->file[0] ? svc->file : "built-in");
-		printf("Environment : %s\n", svc_environ(svc, buf, sizeof(buf)));
-		printf("Condition(s): %s\n", svc_cond(svc, buf, sizeof(buf)));
-		printf("    Command : %s\n", svc_command(svc, buf, sizeof(buf)));
-		printf("   PID file : %s\n", pidfn);
-		printf("        PID : %d\n", svc->pid);
-		printf("       User : %s\n", svc->username);
-		printf("      Group : %s\n", svc->group);
-		printf("     Uptime : %s\n", svc->pid ? uptime(now - svc->start_time, uptm, sizeof(uptm)) : uptm);
-		printf("   Restarts : %d (%d/%d)\n", svc->restart_tot, svc->restart_cnt, svc->restart_max);
-		printf("  Runlevels : %s\n", runlevel_string(runlevel, svc->runlevels));
-		if (cgrp && svc->pid > 1) {
-			char grbuf[128];
-			char path[256];
-			struct cg *cg;
-			char *group;
-
-			group = pid_cgroup(svc->pid, grbuf, sizeof(grbuf));
-			snprintf(path, sizeof(path), "%s/%s", FINIT_CGPATH, group);
-			cg = cg_conf(path);
-
-			printf("     Memory : %s\n", memsz(cgroup_memory(group), uptm, sizeof(uptm)));
-			printf("     CGroup : %s cpu %s [%s, %s] mem [%s, %s]\n",
-			       group, cg->cg_cpu.set, cg->cg_cpu.weight, cg->cg_cpu.max,
-			       cg->cg_mem.min, cg->cg_mem.max);
-			show_cgroup_tree(group, "              ");
+		if (num > 1 && !exact)
+			goto summary;
+
+		svc = &list[0];
+		for (i = 0; exact && i < num; i++) {
+			if (string_case_compare(svc_ident(&list[i], ident, sizeof(ident)), arg)) {
+				svc = &list[i];
+				break;
+			}
 		}
-		printf("\n");
 
-		return do_log(svc->cmd);
-	}
+		rc = show_svc(svc);
+		free(list);
 
-	col_widths();
+		return rc;
+	}
+summary:
+	col_widths(list, num);
 	if (heading) {
 		char title[80];
 
@@ -793,12 +1190,11 @@ static int show_status(char *arg)
 		print_header(title);
 	}
 
-	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+	for (i = 0; i < num; i++) {
 		char *lvls;
 
+		svc = &list[i];
 		svc_ident(svc, ident, sizeof(ident));
-		if (num && !string_compare(ident, arg))
-			continue;
 
 		printf("%-*d  ", pw, svc->pid);
 		printf("%-*s  %s ", iw, ident, status(svc, 0));
@@ -814,6 +1210,7 @@ static int show_status(char *arg)
 		else
 			puts(svc_command(svc, buf, sizeof(buf)));
 	}
+	free(list);
 
 	return 0;
 }
@@ -886,16 +1283,20 @@ static int usage(int rc)
 		"  -b, --batch               Batch mode, no screen size probing\n"
 		"  -c, --create              Create missing paths (and files) as needed\n"
 		"  -f, --force               Ignore missing files and arguments, never prompt\n"
+		"  -F, --follow              Follow service log buffer, see log command\n"
 		"  -1, --once                Only one lap in commands like 'top'\n"
 		"  -p, --plain               Use plain table headings, no ctrl chars\n"
 		"  -q, --quiet               Silent, only return status of command\n"
 		"  -t, --no-heading          Skip table headings\n"
 		"  -v, --verbose             Verbose output\n"
 		"  -V, --version             Show program version\n"
+		"  -w, --wait[=SEC]          Wait for start/stop/restart/reload to complete,\n"
+		"                            or fail, default timeout 30 sec\n"
 		"  -h, --help                This help text\n"
 		"\n"
 		"Commands:\n"
 		"  debug                     Toggle Finit (daemon) debug\n"
+		"  debug    loop             Show event loop callback latency\n"
 		"  help                      This help text\n"
 		"  version                   Show program version\n"
 		"\n", prognm);
@@ -934,13 +1335,16 @@ static int usage(int rc)
 		"  cond     status           Show condition status, default cond command\n"
 		"  cond     dump             Dump all conditions and their status\n"
 		"\n"
-		"  log      [NAME]           Show ten last Finit, or NAME, messages from syslog\n"
+		"  log      [NAME]           Show output buffered for NAME, or last ten Finit,\n"
+		"                            or NAME, messages from syslog\n"
 		"  start    <NAME>[:ID]      Start service by name, with optional ID\n"
 		"  stop     <NAME>[:ID]      Stop/Pause a running service by name\n"
 		"  reload   <NAME>[:ID]      Reload service by name (SIGHUP or restart)\n"
 		"  restart  <NAME>[:ID]      Restart (stop/start) service by name\n"
+		"  batch                     Run start/stop/restart/reload/query commands,\n"
+		"                            one per line from stdin, on one connection\n"
 		"  ident    [NAME]           Show matching identities for NAME, or all\n"
-		"  status   <NAME>[:ID]      Show service status, by name\n"
+		"  status   <NAME>[:ID]      Show service status, by name or pattern\n"
 		"  status                    Show status of services, default command\n");
 	if (cgrp)
 		fprintf(stderr,
@@ -951,6 +1355,8 @@ static int usage(int rc)
 	fprintf(stderr,
 		"\n"
 		"  runlevel [0-9]            Show or set runlevel: 0 halt, 6 reboot\n"
+		"  reexec                    Re-execute Finit, e.g. after upgrade, keeping\n"
+		"                            all services running\n"
 		"  reboot                    Reboot system\n"
 		"  halt                      Halt system\n"
 		"  poweroff                  Halt and power off system\n"
@@ -1025,6 +1431,7 @@ int main(int argc, char *argv[])
 		{ "batch",      0, NULL, 'b' },
 		{ "create",     0, NULL, 'c' },
 		{ "debug",      0, NULL, 'd' },
+		{ "follow",     0, NULL, 'F' },
 		{ "force",      0, NULL, 'f' },
 		{ "help",       0, NULL, 'h' },
 		{ "once",       0, NULL, '1' },
@@ -1033,6 +1440,7 @@ int main(int argc, char *argv[])
 		{ "no-heading", 0, NULL, 't' },
 		{ "verbose",    0, NULL, 'v' },
 		{ "version",    0, NULL, 'V' },
+		{ "wait",       2, NULL, 'w' },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct cmd cond[] = {
@@ -1069,12 +1477,14 @@ int main(int argc, char *argv[])
 		{ "start",    NULL, do_start,     NULL },
 		{ "stop",     NULL, do_stop,      NULL },
 		{ "restart",  NULL, do_restart,   NULL },
+		{ "batch",    NULL, do_batch,     NULL },
 
 		{ "cgroup",   NULL, show_cgroup, &cgrp },
 		{ "ps",       NULL, show_cgps,   &cgrp },
 		{ "top",      NULL, show_cgtop,  &cgrp },
 
 		{ "runlevel", NULL, do_runlevel,  NULL },
+		{ "reexec",   NULL, do_reexec,    NULL },
 		{ "reboot",   NULL, do_reboot,    NULL },
 		{ "halt",     NULL, do_halt,      NULL },
 		{ "poweroff", NULL, do_poweroff,  NULL },
@@ -1083,7 +1493,7 @@ int main(int argc, char *argv[])
 		{ "utmp",     NULL, do_utmp,     &utmp },
 		{ NULL, NULL, NULL, NULL }
 	};
-	int interactive = 1, c;
+	int interactive = 1, c, rc;
 
 	if (transform(progname(argv[0])))
 		return reboot_main(argc, argv);
@@ -1092,7 +1502,7 @@ int main(int argc, char *argv[])
 	cgrp = cgroup_avail();
 	utmp = has_utmp();
 
-	while ((c = getopt_long(argc, argv, "1bcdfh?pqtvV", long_options, NULL)) != EOF) {
+	while ((c = getopt_long(argc, argv, "1bcdfFh?pqtvVw::", long_options, NULL)) != EOF) {
 		switch(c) {
 		case '1':
 			ionce = 1;
@@ -1114,6 +1524,10 @@ int main(int argc, char *argv[])
 			iforce = 1;
 			break;
 
+		case 'F':
+			ifollow = 1;
+			break;
+
 		case 'h':
 		case '?':
 			return usage(0);
@@ -1136,13 +1550,24 @@ int main(int argc, char *argv[])
 
 		case 'V':
 			return show_version(NULL);
+
+		case 'w':
+			iwait = optarg ? atoi(optarg) : 30;
+			if (iwait <= 0)
+				errx(1, "Invalid wait timeout: %s", optarg);
+			break;
 		}
 	}
 
 	if (interactive)
 		ttinit();
 
-	return cmd_parse(argc - optind, &argv[optind], command);
+	/* All requests from this command on one connection */
+	client_session_open();
+	rc = cmd_parse(argc - optind, &argv[optind], command);
+	client_session_close();
+
+	return rc;
 }
 
 void logit(int prio, const char *fmt, ...)
@@ -0,0 +1,239 @@
+/* Per-service software watchdog, keepalive socket for services
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "finit.h"
+#include "keepalive.h"
+#include "log.h"
+#include "loop.h"
+#include "svc.h"
+#include "util.h"
+
+/*
+ * Services with `watchdog:SEC` get FINIT_WATCHDOG, the path to this
+ * socket, and FINIT_WATCHDOG_USEC in their environment.  Any datagram
+ * sent to the socket from the service, or any process in its process
+ * group, counts as a keepalive.  The sender is identified from its
+ * credentials, so nothing needs to be sent but a single byte.
+ */
+static uev_t watcher;
+
+static svc_t *sender(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	struct ucred *cred;
+	svc_t *svc;
+	pid_t pgid;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_CREDENTIALS)
+			continue;
+
+		cred = (struct ucred *)CMSG_DATA(cmsg);
+		svc = svc_find_by_pid(cred->pid);
+		if (svc)
+			return svc;
+
+		/* Worker process, services are session leaders */
+		pgid = getpgid(cred->pid);
+		if (pgid > 1)
+			return svc_find_by_pid(pgid);
+	}
+
+	return NULL;
+}
+
+static void keepalive_cb(uev_t *w, void *arg, int events)
+{
+	char ctrl[CMSG_SPACE(sizeof(struct ucred))];
+	char buf[64];
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len  = sizeof(buf),
+	};
+	struct msghdr msg = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = ctrl,
+		.msg_controllen = sizeof(ctrl),
+	};
+	svc_t *svc;
+
+	if (UEV_ERROR == events) {
+		_e("Keepalive socket error, restarting watcher.");
+		uev_io_start(w);
+		return;
+	}
+
+	/* Drain all pending keepalives */
+	while (recvmsg(w->fd, &msg, MSG_DONTWAIT) >= 0) {
+		svc = sender(&msg);
+		if (svc && svc->wdog && svc->wdog_ping) {
+			svc->wdog_ping = mono_usec();
+			uev_timer_set(&svc->wdog_timer, svc->wdog * 1000, 0);
+		}
+
+		msg.msg_controllen = sizeof(ctrl);
+	}
+}
+LOOP_PROBE(keepalive_cb)
+
+/*
+ * No keepalive within the interval, kill the process group.  It is then
+ * collected like any crashed service and restarted by service_retry().
+ */
+static void expire_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc = (svc_t *)arg;
+
+	if (svc->pid <= 1)
+		return;
+
+	/* Disabled by initctl reload */
+	if (!svc->wdog) {
+		keepalive_stop(svc);
+		return;
+	}
+
+	/* SIGSTOP'ed while waiting for conditions, or starting/stopping */
+	if (svc->state != SVC_RUNNING_STATE) {
+		svc->wdog_ping = mono_usec();
+		uev_timer_set(w, svc->wdog * 1000, 0);
+		return;
+	}
+
+	logit(LOG_CONSOLE | LOG_WARNING, "Service %s[%d] missed its %d sec watchdog, restarting.",
+	      svc_ident(svc, NULL, 0), svc->pid, svc->wdog);
+	svc->wdog_cnt++;
+	kill(-svc->pid, SIGKILL);
+}
+LOOP_PROBE(expire_cb)
+
+/**
+ * keepalive_start - Arm software watchdog for a started service
+ * @svc: Service with watchdog:SEC, just started
+ *
+ * Returns:
+ * POSIX OK(0) or non-zero on error.
+ */
+int keepalive_start(svc_t *svc)
+{
+	if (!svc->wdog)
+		return 0;
+
+	keepalive_stop(svc);
+	svc->wdog_ping = mono_usec();
+
+	return uev_timer_init(ctx, &svc->wdog_timer, LOOP_CB(expire_cb), svc, svc->wdog * 1000, 0);
+}
+
+/**
+ * keepalive_stop - Disarm software watchdog
+ * @svc: Service that has been collected, or is removed
+ */
+void keepalive_stop(svc_t *svc)
+{
+	if (!svc->wdog_ping)
+		return;
+
+	uev_timer_stop(&svc->wdog_timer);
+	svc->wdog_ping = 0;
+}
+
+/**
+ * keepalive_env - Set up environment for service, after fork()
+ * @svc: Service with watchdog:SEC
+ */
+void keepalive_env(svc_t *svc)
+{
+	char usec[24];
+
+	if (!svc->wdog || watcher.fd <= 0)
+		return;
+
+	snprintf(usec, sizeof(usec), "%llu", (unsigned long long)svc->wdog * 1000000);
+	setenv("FINIT_WATCHDOG", KEEPALIVE_SOCKET, 1);
+	setenv("FINIT_WATCHDOG_USEC", usec, 1);
+}
+
+/**
+ * keepalive_init - Open keepalive socket
+ * @ctx: Event context
+ *
+ * The socket is re-created on every start, also after initctl reexec.
+ * Services keep sending to the same path.
+ *
+ * Returns:
+ * POSIX OK(0) or non-zero on error.
+ */
+int keepalive_init(uev_ctx_t *ctx)
+{
+	struct sockaddr_un sun = {
+		.sun_family = AF_UNIX,
+		.sun_path   = KEEPALIVE_SOCKET,
+	};
+	int on = 1;
+	int sd;
+
+	sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd == -1) {
+		_pe("Failed opening keepalive socket");
+		return 1;
+	}
+
+	if (setsockopt(sd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)))
+		goto error;
+
+	erase(KEEPALIVE_SOCKET);
+	if (bind(sd, (struct sockaddr *)&sun, sizeof(sun)))
+		goto error;
+
+	/* Services may run as any user, senders are checked by PID */
+	chmod(KEEPALIVE_SOCKET, 0666);
+
+	if (uev_io_init(ctx, &watcher, LOOP_CB(keepalive_cb), NULL, sd, UEV_READ))
+		goto error;
+
+	return 0;
+error:
+	_pe("Failed setting up keepalive socket %s", KEEPALIVE_SOCKET);
+	close(sd);
+	return 1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -1,4 +1,4 @@
-/* Listens to kernel events like AC power status and manages sys/ conditions
+/* Listens to kernel events like AC power status and manages sys/ and dev/ conditions
  *
  * Copyright (c) 2021  Joachim Wiberg <troglobit@gmail.com>
  *
@@ -23,7 +23,12 @@
 
 #include <errno.h>
 #include <dirent.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <libgen.h>
 #include <poll.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -31,16 +36,20 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <linux/filter.h>
 #include <linux/types.h>
 #include <linux/netlink.h>
 
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
+# include <libite/queue.h>
 #else
 # include <lite/lite.h>
+# include <lite/queue.h>
 #endif
 
 #include "cond.h"
@@ -48,6 +57,70 @@
 #include "util.h"
 
 #define _PATH_SYSFS_PWR  "/sys/class/power_supply"
+#define _PATH_KEVENTD    "/etc/keventd.conf"
+#define _PATH_UDEV_CTRL  "/run/udev/control"
+#define _PATH_UDEV_DATA  "/run/udev/data"
+
+#define UEVENT_BUFSZ     16384		/* Kernel events are max 2 KiB, udev's larger */
+#define UEVENT_RCVBUF    (1024 * 1024)
+#define PROP_MAX         128
+#define MATCH_MAX        8
+#define FILTER_MAX       64		/* Subsystems in socket filter */
+
+#define MONITOR_KERNEL   1
+#define MONITOR_UDEV     2
+#define UDEV_MAGIC       0xfeedcafe
+
+/* Head of libudev monitor messages, in host byte order except magic/hashes */
+struct udev_hdr {
+	char         prefix[8];
+	unsigned int magic;
+	unsigned int header_size;
+	unsigned int properties_off;
+	unsigned int properties_len;
+	unsigned int filter_subsystem_hash;
+	unsigned int filter_devtype_hash;
+	unsigned int filter_tag_bloom_hi;
+	unsigned int filter_tag_bloom_lo;
+};
+
+/* Received message, or synthesized from sysfs, as KEY=VALUE strings */
+struct uevent {
+	char    buf[UEVENT_BUFSZ];
+	size_t  len;
+	char   *prop[PROP_MAX];
+	int     num;
+};
+
+struct match {
+	char *key;			/* Property, or sysfs attribute */
+	char *pattern;			/* fnmatch(3) pattern */
+	int   attr;
+};
+
+/*
+ * One line in /etc/keventd.conf, asserts dev/COND while at least one
+ * device matching all its properties and attributes is present.
+ */
+struct rule {
+	TAILQ_ENTRY(rule) link;
+
+	char         *line;
+	char         *cond;
+	struct match  match[MATCH_MAX];
+	int           num;
+
+	char        **devs;		/* DEVPATH of matching devices */
+	int           ndevs;
+};
+
+TAILQ_HEAD(rules, rule);
+
+static struct rules rules = TAILQ_HEAD_INITIALIZER(rules);
+static struct uevent ev;
+
+static volatile sig_atomic_t reload;
+static int udev;
 
 static int num_ac_online;
 static int num_ac;
@@ -84,6 +157,25 @@ static void sys_cond(char *cond, int set)
 	}
 }
 
+static void dev_cond(char *cond, int set)
+{
+	char oneshot[256];
+
+	snprintf(oneshot, sizeof(oneshot), "%s%s", _PATH_CONDDEV, cond);
+	if (set) {
+		char dir[sizeof(oneshot)];
+
+		strlcpy(dir, oneshot, sizeof(dir));
+		if (mkpath(dirname(dir), 0755) && errno != EEXIST)
+			warn("failed creating %s", dir);
+		if (symlink(_PATH_RECONF, oneshot) && errno != EEXIST)
+			warn("failed asserting dev/%s", cond);
+	} else {
+		if (erase(oneshot) && errno != ENOENT)
+			warn("failed deasserting dev/%s", cond);
+	}
+}
+
 static int fgetline(char *path, char *buf, size_t len)
 {
 	FILE *fp;
@@ -127,6 +219,9 @@ static int is_ac(char *type)
 	};
 	int i;
 
+	if (!type)
+		return 0;
+
 	for (i = 0; types[i]; i++) {
 		if (!strncmp(type, types[i], strlen(types[i])))
 			return 1;
@@ -141,18 +236,19 @@ static void init(void)
 	char *cond_dirs[] = {
 		_PATH_CONDSYS,
 		_PATH_CONDSYS "/pwr",
+		_PATH_CONDDEV,
 	};
 	char path[384];
 	int i, n;
 
 	for (i = 0; i < (int)NELEMS(cond_dirs); i++) {
 		if (mkpath(cond_dirs[i], 0755) && errno != EEXIST) {
-			_pe("Failed creating %s condition directory, %s", COND_SYS,
-			    cond_dirs[i]);
+			_pe("Failed creating condition directory %s", cond_dirs[i]);
 			return;
 		}
 	}
 
+	num_ac = num_ac_online = 0;
 	n = scandir(_PATH_SYSFS_PWR, &d, NULL, alphasort);
 	for (i = 0; i < n; i++) {
 		char *nm = d[i]->d_name;
@@ -175,8 +271,488 @@ static void init(void)
 		free(d);
 
 	/* if any power_supply is online, or none can be found */
-	if (num_ac == 0 || num_ac_online > 0)
-		sys_cond("pwr/ac", 1);
+	sys_cond("pwr/ac", num_ac == 0 || num_ac_online > 0);
+}
+
+static char *prop(struct uevent *e, const char *key)
+{
+	size_t len = strlen(key);
+	int i;
+
+	for (i = 0; i < e->num; i++) {
+		if (!strncmp(e->prop[i], key, len) && e->prop[i][len] == '=')
+			return &e->prop[i][len + 1];
+	}
+
+	return NULL;
+}
+
+static int add(struct uevent *e, const char *fmt, ...)
+{
+	size_t room = sizeof(e->buf) - e->len;
+	va_list ap;
+	int len;
+
+	if (e->num >= PROP_MAX)
+		return 1;
+
+	va_start(ap, fmt);
+	len = vsnprintf(&e->buf[e->len], room, fmt, ap);
+	va_end(ap);
+	if (len < 0 || (size_t)len >= room)
+		return 1;
+
+	e->prop[e->num++] = &e->buf[e->len];
+	e->len += len + 1;
+
+	return 0;
+}
+
+/*
+ * Kernel messages start with ACTION@DEVPATH, udev messages with a
+ * header pointing out the properties.  Both are KEY=VALUE strings.
+ */
+static int parse(struct uevent *e, size_t len)
+{
+	size_t off, end;
+
+	e->num = 0;
+	if (!strcmp(e->buf, "libudev")) {
+		struct udev_hdr *hdr = (struct udev_hdr *)e->buf;
+
+		if (len < sizeof(*hdr) || ntohl(hdr->magic) != UDEV_MAGIC)
+			return 1;
+
+		off = hdr->properties_off;
+		end = off + hdr->properties_len;
+		if (end > len)
+			return 1;
+	} else {
+		if (!strchr(e->buf, '@'))
+			return 1;
+
+		off = strlen(e->buf) + 1;
+		end = len;
+	}
+
+	while (off < end && e->num < PROP_MAX) {
+		e->prop[e->num++] = &e->buf[off];
+		off += strlen(&e->buf[off]) + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse /etc/keventd.conf, one rule per line:
+ *
+ *     COND  KEY=PATTERN [ATTR{file}=PATTERN ...]
+ */
+static void load(struct rules *list)
+{
+	char line[512];
+	FILE *fp;
+
+	fp = fopen(_PATH_KEVENTD, "r");
+	if (!fp) {
+		if (errno != ENOENT)
+			warn("failed opening %s", _PATH_KEVENTD);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr, *tok, *save = NULL;
+		struct rule *r;
+
+		chomp(line);
+		ptr = line;
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+		if (!*ptr || *ptr == '#')
+			continue;
+
+		r = calloc(1, sizeof(*r));
+		if (!r || !(r->line = strdup(ptr))) {
+			free(r);
+			break;
+		}
+
+		r->cond = strtok_r(r->line, " \t", &save);
+		while ((tok = strtok_r(NULL, " \t", &save))) {
+			struct match *m;
+			char *eq;
+
+			eq = strchr(tok, '=');
+			if (!eq || r->num == MATCH_MAX) {
+				logit(LOG_WARNING, "Skipping invalid match %s for %s", tok, r->cond);
+				continue;
+			}
+			*eq++ = 0;
+			if (*eq == '=')
+				eq++;
+
+			m = &r->match[r->num++];
+			m->pattern = eq;
+			m->key = tok;
+			if (!strncmp(tok, "ATTR{", 5) && tok[strlen(tok) - 1] == '}') {
+				tok[strlen(tok) - 1] = 0;
+				m->key = &tok[5];
+				m->attr = 1;
+			}
+		}
+
+		if (!r->num) {
+			logit(LOG_WARNING, "Skipping rule for %s, no matches", r->cond);
+			free(r->line);
+			free(r);
+			continue;
+		}
+
+		TAILQ_INSERT_TAIL(list, r, link);
+	}
+
+	fclose(fp);
+}
+
+static void drop(struct rules *list)
+{
+	struct rule *r, *tmp;
+	int i;
+
+	TAILQ_FOREACH_SAFE(r, list, link, tmp) {
+		TAILQ_REMOVE(list, r, link);
+		for (i = 0; i < r->ndevs; i++)
+			free(r->devs[i]);
+		free(r->devs);
+		free(r->line);
+		free(r);
+	}
+}
+
+static int match(struct rule *r, struct uevent *e)
+{
+	char *devpath = prop(e, "DEVPATH");
+	int i;
+
+	for (i = 0; i < r->num; i++) {
+		struct match *m = &r->match[i];
+		char path[512], buf[256];
+		char *val;
+
+		if (m->attr) {
+			if (!devpath)
+				return 0;
+
+			snprintf(path, sizeof(path), "/sys%s/%s", devpath, m->key);
+			if (fgetline(path, buf, sizeof(buf)))
+				return 0;
+			val = buf;
+		} else
+			val = prop(e, m->key);
+
+		if (!val || fnmatch(m->pattern, val, 0))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Several rules may share the same condition */
+static void update(char *cond)
+{
+	struct rule *r;
+
+	TAILQ_FOREACH(r, &rules, link) {
+		if (r->ndevs && !strcmp(r->cond, cond)) {
+			dev_cond(cond, 1);
+			return;
+		}
+	}
+
+	dev_cond(cond, 0);
+}
+
+static void track(struct rule *r, char *devpath, int present)
+{
+	int i;
+
+	for (i = 0; i < r->ndevs; i++) {
+		if (!strcmp(r->devs[i], devpath))
+			break;
+	}
+
+	if (present && i == r->ndevs) {
+		char **devs;
+
+		devs = realloc(r->devs, (r->ndevs + 1) * sizeof(char *));
+		if (!devs)
+			return;
+		r->devs = devs;
+		r->devs[r->ndevs] = strdup(devpath);
+		if (!r->devs[r->ndevs])
+			return;
+
+		logit(LOG_DEBUG, "%s matches dev/%s", devpath, r->cond);
+		if (r->ndevs++ == 0)
+			update(r->cond);
+	} else if (!present && i < r->ndevs) {
+		free(r->devs[i]);
+		r->devs[i] = r->devs[--r->ndevs];
+		if (!r->ndevs)
+			update(r->cond);
+	}
+}
+
+/*
+ * Every event carries all properties of the device, so each rule can
+ * be reevaluated, e.g., an unbind event no longer has a DRIVER.
+ */
+static void handle(struct uevent *e)
+{
+	char *action, *devpath, *old;
+	struct rule *r;
+
+	action  = prop(e, "ACTION");
+	devpath = prop(e, "DEVPATH");
+	if (!action || !devpath)
+		return;
+
+	old = prop(e, "DEVPATH_OLD");
+	TAILQ_FOREACH(r, &rules, link) {
+		if (old)
+			track(r, old, 0);
+		track(r, devpath, strcmp(action, "remove") && match(r, e));
+	}
+}
+
+static void power(struct uevent *e)
+{
+	char *action, *subsys;
+
+	action = prop(e, "ACTION");
+	subsys = prop(e, "SUBSYSTEM");
+	if (!action || strcmp(action, "change") || !subsys || strcmp(subsys, "power_supply"))
+		return;
+
+	if (!is_ac(prop(e, "POWER_SUPPLY_TYPE")) || !prop(e, "POWER_SUPPLY_ONLINE"))
+		return;
+
+	if (check_online(prop(e, "POWER_SUPPLY_ONLINE"))) {
+		if (!num_ac_online)
+			sys_cond("pwr/ac", 1);
+		num_ac_online++;
+	} else {
+		if (num_ac_online > 0)
+			num_ac_online--;
+		if (!num_ac_online)
+			sys_cond("pwr/ac", 0);
+	}
+}
+
+/*
+ * Properties added by udev, e.g. ID_SERIAL, are only in its database
+ */
+static void udev_data(struct uevent *e, char *devpath)
+{
+	char *subsys, *major, *minor, *ifindex;
+	char path[512], line[512];
+	FILE *fp;
+
+	subsys  = prop(e, "SUBSYSTEM");
+	major   = prop(e, "MAJOR");
+	minor   = prop(e, "MINOR");
+	ifindex = prop(e, "IFINDEX");
+
+	if (major && minor)
+		snprintf(path, sizeof(path), "%s/%c%s:%s", _PATH_UDEV_DATA,
+			 subsys && !strcmp(subsys, "block") ? 'b' : 'c', major, minor);
+	else if (ifindex)
+		snprintf(path, sizeof(path), "%s/n%s", _PATH_UDEV_DATA, ifindex);
+	else if (subsys)
+		snprintf(path, sizeof(path), "%s/+%s:%s", _PATH_UDEV_DATA, subsys, basename(devpath));
+	else
+		return;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "E:", 2))
+			continue;
+		chomp(line);
+		add(e, "%s", &line[2]);
+	}
+	fclose(fp);
+}
+
+/* Synthesize an add event for each device in sysfs */
+static int scan_one(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+{
+	char path[512], link[512], line[512];
+	char *devpath;
+	ssize_t len;
+	FILE *fp;
+
+	(void)sb;
+	if (tflag != FTW_F || strcmp(&fpath[ftw->base], "uevent"))
+		return 0;
+
+	strlcpy(path, fpath, sizeof(path));
+	devpath = dirname(path);
+
+	ev.len = 0;
+	ev.num = 0;
+	add(&ev, "ACTION=add");
+	add(&ev, "DEVPATH=%s", &devpath[4]);
+
+	strlcpy(line, devpath, sizeof(line));
+	strlcat(line, "/subsystem", sizeof(line));
+	len = readlink(line, link, sizeof(link) - 1);
+	if (len > 0) {
+		link[len] = 0;
+		add(&ev, "SUBSYSTEM=%s", basename(link));
+	}
+
+	fp = fopen(fpath, "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp)) {
+			chomp(line);
+			add(&ev, "%s", line);
+		}
+		fclose(fp);
+	}
+
+	if (udev)
+		udev_data(&ev, &devpath[4]);
+
+	handle(&ev);
+
+	return 0;
+}
+
+/*
+ * Only udev messages can be filtered in the kernel, they carry a hash
+ * of the subsystem at a fixed offset.  This is MurmurHash2, as used by
+ * udev, in host byte order.
+ */
+static unsigned int hash(const char *str)
+{
+	const unsigned int m = 0x5bd1e995;
+	const unsigned char *data = (const unsigned char *)str;
+	int len = strlen(str);
+	unsigned int h = len;
+
+	while (len >= 4) {
+		unsigned int k;
+
+		memcpy(&k, data, sizeof(k));
+		k *= m;
+		k ^= k >> 24;
+		k *= m;
+		h *= m;
+		h ^= k;
+
+		data += 4;
+		len  -= 4;
+	}
+
+	switch (len) {
+	case 3:
+		h ^= data[2] << 16;
+		/* fallthrough */
+	case 2:
+		h ^= data[1] << 8;
+		/* fallthrough */
+	case 1:
+		h ^= data[0];
+		h *= m;
+	}
+
+	h ^= h >> 13;
+	h *= m;
+	h ^= h >> 15;
+
+	return h;
+}
+
+/*
+ * Let through only subsystems that rules, or the AC power monitor,
+ * care about.  Rules without a plain SUBSYSTEM match disable the
+ * filter, as do kernel messages which have no fixed layout.
+ */
+static void filter(int sd)
+{
+	struct sock_filter ins[2 * FILTER_MAX + 6];
+	struct sock_fprog prog = { 0 };
+	struct rule *r;
+	int n = 0, num = 0;
+
+	(void)setsockopt(sd, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+	if (!udev)
+		return;
+
+	ins[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct udev_hdr, magic));
+	ins[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, UDEV_MAGIC, 1, 0);
+	ins[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	ins[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct udev_hdr, filter_subsystem_hash));
+	ins[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hash("power_supply"), 0, 1);
+	ins[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+	TAILQ_FOREACH(r, &rules, link) {
+		char *subsys = NULL;
+		int i;
+
+		for (i = 0; i < r->num; i++) {
+			if (!r->match[i].attr && !strcmp(r->match[i].key, "SUBSYSTEM"))
+				subsys = r->match[i].pattern;
+		}
+
+		if (!subsys || strpbrk(subsys, "*?[") || ++num > FILTER_MAX)
+			return;
+
+		ins[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hash(subsys), 0, 1);
+		ins[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	}
+	ins[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+	prog.len    = n;
+	prog.filter = ins;
+	if (setsockopt(sd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)))
+		warn("failed attaching socket filter");
+}
+
+/*
+ * Called at start, on SIGHUP, and when events have been lost.  Reload
+ * rules and rescan all devices, then drop conditions no longer held.
+ */
+static void resync(int sd)
+{
+	struct rules old = TAILQ_HEAD_INITIALIZER(old);
+	struct rule *r;
+
+	while ((r = TAILQ_FIRST(&rules))) {
+		TAILQ_REMOVE(&rules, r, link);
+		TAILQ_INSERT_TAIL(&old, r, link);
+	}
+	load(&rules);
+	filter(sd);
+
+	init();
+	if (!TAILQ_EMPTY(&rules))
+		nftw("/sys/devices", scan_one, 20, FTW_PHYS);
+
+	TAILQ_FOREACH(r, &rules, link)
+		update(r->cond);
+	TAILQ_FOREACH(r, &old, link)
+		update(r->cond);
+	drop(&old);
+}
+
+static void sighup(int signo)
+{
+	(void)signo;
+	reload = 1;
 }
 
 /*
@@ -185,12 +761,17 @@ static void init(void)
  * now we should have /sys/class/power_supply/ available for probing.
  * If none is found we assert /sys/pwr/ac condition anyway, this is what
  * systemd does (ConditionACPower) and also makes most sense.
+ *
+ * When udevd runs we listen to its events instead of the kernel's, to
+ * be able to match on properties from udev rules, and to filter out
+ * subsystems no rule is interested in already in the kernel.
  */
 int main(int argc, char *argv[])
 {
 	struct sockaddr_nl nls = { 0 };
+	struct sigaction sa = { 0 };
 	struct pollfd pfd;
-	char buf[1024];
+	int sz = UEVENT_RCVBUF;
 
 	if (argc > 1) {
 		if (!strcmp(argv[1], "-d"))
@@ -202,74 +783,67 @@ int main(int argc, char *argv[])
 		setlogmask(LOG_UPTO(LOG_NOTICE));
 	}
 
-	init();
+	sa.sa_handler = sighup;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGHUP, &sa, NULL);
+
+	udev = !access(_PATH_UDEV_CTRL, F_OK);
 
 	pfd.events = POLLIN;
-	pfd.fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+	pfd.fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
 	if (pfd.fd == -1)
 		panic("failed creating netlink socket");
 
+	if (setsockopt(pfd.fd, SOL_SOCKET, SO_RCVBUFFORCE, &sz, sizeof(sz)))
+		(void)setsockopt(pfd.fd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+
 	nls.nl_family = AF_NETLINK;
 	nls.nl_pid    = 0;
-	nls.nl_groups = -1;
+	nls.nl_groups = udev ? MONITOR_UDEV : MONITOR_KERNEL;
 	if (bind(pfd.fd, (void *)&nls, sizeof(struct sockaddr_nl)))
 		panic("bind failed");
 
-	logit(LOG_DEBUG, "Waiting for events ...");
-	while (-1 != poll(&pfd, 1, -1)) {
-		char *path = NULL;
-		int ac = 0;
-		int i, len;
+	resync(pfd.fd);
+
+	logit(LOG_DEBUG, "Waiting for %s events ...", udev ? "udev" : "kernel");
+	while (1) {
+		ssize_t len;
+
+		if (reload) {
+			reload = 0;
+			resync(pfd.fd);
+		}
+
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			panic("poll failed");
+		}
+
+		while ((len = recv(pfd.fd, ev.buf, sizeof(ev.buf) - 1, MSG_DONTWAIT)) > 0) {
+			ev.buf[len] = 0;
+			if (parse(&ev, len))
+				continue;
+
+			power(&ev);
+			handle(&ev);
+		}
 
-		len = recv(pfd.fd, buf, sizeof(buf), MSG_DONTWAIT);
 		if (len == -1) {
 			switch (errno) {
+			case EAGAIN:
 			case EINTR:
-				continue;
+				break;
 			case ENOBUFS:
-				warn("lost events");
-				continue;
+				logit(LOG_WARNING, "Lost events, resyncing");
+				reload = 1;
+				break;
 			default:
 				panic("unhandled");
-				continue;
-			}
-		}
-		buf[len] = 0;
-
-		/* skip libusb events, focus on kernel events/changes */
-		if (strncmp(buf, "change@", 7))
-			continue;
-
-		/* XXX: currently limited to monitoring this subsystem */
-		if (!strstr(buf, "power_supply"))
-			continue;
-
-		i = 0;
-		while (i < len) {
-			char *line = buf + i;
-
-			logit(LOG_DEBUG, "%s", line);
-			if (!strncmp(line, "DEVPATH=", 8)) {
-				path = &line[8];
-				logit(LOG_DEBUG, "Got path %s", path);
-			} else if (!strncmp(line, "POWER_SUPPLY_TYPE=", 18)) {
-				ac = is_ac(&line[18]);
-			} else if (!strncmp(line, "POWER_SUPPLY_ONLINE=", 20) && ac) {
-				if (check_online(&line[20])) {
-					if (!num_ac_online)
-						sys_cond("pwr/ac", 1);
-					num_ac_online++;
-				} else {
-					if (num_ac_online > 0)
-						num_ac_online--;
-					if (!num_ac_online)
-						sys_cond("pwr/ac", 0);
-				}
 			}
-
-			i += strlen(line) + 1;
 		}
 	}
+
 	close(pfd.fd);
 
 	return 0;
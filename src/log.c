@@ -22,8 +22,13 @@
  */
 
 #include "config.h"
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 #else
@@ -33,10 +38,30 @@
 #include "finit.h"
 #include "helpers.h"
 #include "log.h"
+#include "loop.h"
 #include "util.h"
 
+#define EARLY_MAX 64		/* Messages kept until syslogd is up */
+#define EARLY_LEN 256		/* Longer messages are truncated in the ring */
+#define KMSG_LEN  1024		/* Max message to /dev/kmsg, kernel record size */
+
 static int up       = 0;
+static int probe    = 1;	/* Check for /dev/log on every message */
 static int loglevel = LOG_INFO;
+static int kmsg_fd  = -1;
+
+/*
+ * Early log ring, everything sent to /dev/kmsg before syslogd is up is
+ * also saved here and replayed to syslog when /dev/log appears.  That
+ * way the boot is in the persistent log, not only in the kernel ring.
+ */
+static struct {
+	int  prio;
+	char msg[EARLY_LEN];
+} early[EARLY_MAX];
+static int early_head;
+static int early_cnt;
+static int early_lost;
 
 void log_init(void)
 {
@@ -84,26 +109,93 @@ void log_debug(void)
 		loglevel = LOG_NOTICE;
 		ttinit();
 	}
-	log_open();
+	if (up)
+		log_open();
 
 	logit(LOG_NOTICE, "Debug mode %s", debug ? "enabled" : "disabled");
 }
 
+static void early_save(int prio, const char *msg)
+{
+	if (early_cnt == EARLY_MAX)
+		early_lost++;
+	else
+		early_cnt++;
+
+	early[early_head].prio = prio;
+	strlcpy(early[early_head].msg, msg, sizeof(early[early_head].msg));
+	early_head = (early_head + 1) % EARLY_MAX;
+}
+
+/*
+ * Called when /dev/log appears, replays the early log ring, oldest
+ * message first, and then continues logging as a regular daemon.
+ */
+static void log_up(void)
+{
+	int i, pos;
+
+	log_open();
+
+	if (early_lost)
+		syslog(LOG_WARNING, "Early log overrun, %d messages lost", early_lost);
+
+	pos = (early_head + EARLY_MAX - early_cnt) % EARLY_MAX;
+	for (i = 0; i < early_cnt; i++) {
+		syslog(early[pos].prio, "%s", early[pos].msg);
+		pos = (pos + 1) % EARLY_MAX;
+	}
+
+	early_cnt  = 0;
+	early_lost = 0;
+}
+
+/*
+ * Keep /dev/kmsg open and send each message with a single writev(),
+ * the kernel treats every write as a separate log record.
+ */
+static void kmsg(int prio, const char *msg)
+{
+	struct iovec iov[2];
+	char hdr[32];
+	int len;
+
+	if (kmsg_fd < 0) {
+		kmsg_fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+		if (kmsg_fd < 0) {
+			fputs(msg, stderr);
+			return;
+		}
+	}
+
+	len = snprintf(hdr, sizeof(hdr), "<%d>finit[1]:", LOG_DAEMON | prio);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len  = len;
+	iov[1].iov_base = (char *)msg;
+	iov[1].iov_len  = strlen(msg);
+
+	if (writev(kmsg_fd, iov, NELEMS(iov)) < 0) {
+		close(kmsg_fd);
+		kmsg_fd = -1;
+		fputs(msg, stderr);
+	}
+}
+
 /*
  * Log to /dev/kmsg until syslogd has started, then openlog()
  * and continue logging as a regular daemon.
  */
 void logit(int prio, const char *fmt, ...)
 {
-	FILE *fp;
+	char msg[KMSG_LEN];
 	va_list ap;
 
-	va_start(ap, fmt);
+	if (!up && probe && fexist(_PATH_LOG))
+		log_up();
 
-	if (up || fexist("/dev/log")) {
-		if (!up)
-			log_open();
+	va_start(ap, fmt);
 
+	if (up) {
 		vsyslog(prio, fmt, ap);
 		goto done;
 	}
@@ -111,24 +203,98 @@ void logit(int prio, const char *fmt, ...)
 	if (LOG_PRI(prio) > loglevel)
 		goto done;
 
-	fp = fopen("/dev/kmsg", "w");
-	if (!fp) {
-		vfprintf(stderr, fmt, ap);
-		goto done;
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	early_save(prio, msg);
+	kmsg(prio, msg);
+
+	if (debug)
+		fputs(msg, stderr);
+
+done:
+	va_end(ap);
+}
+
+/*
+ * Track /dev/log, it is created by syslogd when it starts and removed
+ * when it exits.  A dangling symlink, e.g. to a socket in /run, means
+ * syslogd is on its way, so we fall back to probing on every message.
+ */
+static void log_cb(uev_t *w, void *arg, int events)
+{
+	static char ev_buf[8 *(sizeof(struct inotify_event) + NAME_MAX + 1) + 1];
+	struct inotify_event *ev;
+	ssize_t sz;
+	size_t off;
+
+	(void)arg;
+	if (UEV_ERROR == events) {
+		uev_io_start(w);
+		return;
 	}
 
-	fprintf(fp, "<%d>finit[1]:", LOG_DAEMON | prio);
-	vfprintf(fp, fmt, ap);
-	fclose(fp);
+	sz = read(w->fd, ev_buf, sizeof(ev_buf) - 1);
+	if (sz <= 0)
+		return;
+	ev_buf[sz] = 0;
 
-	if (debug) {
-		va_end(ap);
-		va_start(ap, fmt);
-		vfprintf(stderr, fmt, ap);
+	for (off = 0; off + sizeof(*ev) <= (size_t)sz; off += sizeof(*ev) + ev->len) {
+		ev = (struct inotify_event *)&ev_buf[off];
+		if (off + sizeof(*ev) + ev->len > (size_t)sz)
+			break;
+
+		if (!ev->len || strcmp(ev->name, "log"))
+			continue;
+
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			if (fexist(_PATH_LOG)) {
+				probe = 0;
+				if (!up)
+					log_up();
+			} else
+				probe = 1;
+		} else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			probe = 0;
+			if (up) {
+				closelog();
+				up = 0;
+			}
+		}
 	}
+}
+LOOP_PROBE(log_cb)
 
-done:
-	va_end(ap);
+/*
+ * Called when the event loop is ready.  We do not use iwatch_add() here
+ * since its default mask includes IN_MODIFY, which for /dev triggers on
+ * every write to a TTY, e.g. the console.
+ */
+void log_monitor(void)
+{
+	static uev_t watcher;
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		_pe("Failed creating /dev/log watcher, falling back to polling");
+		return;
+	}
+
+	if (inotify_add_watch(fd, "/dev", IN_ONLYDIR | IN_CREATE | IN_DELETE | IN_MOVE) < 0) {
+		_pe("Failed watching /dev for %s, falling back to polling", _PATH_LOG);
+		close(fd);
+		return;
+	}
+
+	if (uev_io_init(ctx, &watcher, LOOP_CB(log_cb), NULL, fd, UEV_READ)) {
+		_pe("Failed setting up I/O callback for %s watcher", _PATH_LOG);
+		close(fd);
+		return;
+	}
+
+	/* From now on we rely on inotify, unless it's already there */
+	probe = 0;
+	if (!up && fexist(_PATH_LOG))
+		log_up();
 }
 
 /*
@@ -26,6 +26,8 @@
 
 #include <syslog.h>
 
+extern int debug;		/* defined in finit, initctl, or keventd */
+
 /* Local facility, unused in GNU but available in FreeBSD or sysklogd >= 2.0 */
 #ifndef LOG_CONSOLE
 #define LOG_CONSOLE  (14<<3)
@@ -39,14 +41,30 @@
  *
  * The default log level is LOG_NOTICE.  To toggle LOG_DEBUG messages,
  * use `initctl debug` or add `debug` to the kernel cmdline.
+ *
+ * Arguments to _d() are only evaluated when debug is enabled, so it is
+ * safe to call even expensive functions in them.  Built with
+ * DISABLE_DEBUG_LOG (--disable-debug-log) all _d() are removed, but
+ * the compiler still type checks the format string and arguments.
  */
-#define  _d(fmt, args...) logit(LOG_DEBUG,   "%s():" fmt "\n", __func__, ##args)
+#ifdef DISABLE_DEBUG_LOG
+#define log_is_debug()    0
+#else
+#define log_is_debug()    debug
+#endif
+
+#define  _d(fmt, args...)						\
+	do {								\
+		if (log_is_debug())					\
+			logit(LOG_DEBUG, "%s():" fmt "\n", __func__, ##args); \
+	} while (0)
 #define  _w(fmt, args...) logit(LOG_WARNING, "%s():" fmt "\n", __func__, ##args)
 #define  _e(fmt, args...) logit(LOG_ERR,     "%s():" fmt "\n", __func__, ##args)
 #define _pe(fmt, args...) logit(LOG_ERR,     "%s():" fmt ": %s\n", __func__, ##args, strerror(errno))
 
 void    log_init        (void);
 void    log_exit        (void);
+void    log_monitor     (void);
 
 void    log_debug       (void);
 
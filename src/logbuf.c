@@ -0,0 +1,163 @@
+/* Per-service in-memory log buffer, last output from each service
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "logbuf.h"
+
+/**
+ * logbuf_new - Create, or resize, a log buffer
+ * @lb:   Existing log buffer, or %NULL
+ * @size: Byte budget
+ *
+ * An existing buffer of the same size is returned as-is.  Resizing
+ * discards the buffered output and may move the buffer, including its
+ * watcher, so call logbuf_close() on it first.
+ *
+ * Returns:
+ * Pointer to log buffer, or %NULL if out of memory.
+ */
+struct logbuf *logbuf_new(struct logbuf *lb, size_t size)
+{
+	struct logbuf *new;
+
+	if (lb && lb->size == size)
+		return lb;
+
+	new = realloc(lb, sizeof(*lb) + size);
+	if (!new)
+		return NULL;
+
+	if (!lb) {
+		new->fd      = -1;
+		new->lfd     = -1;
+		new->lost    = 0;
+		new->dropped = 0;
+	}
+	new->total = 0;
+	new->size  = size;
+
+	return new;
+}
+
+/*
+ * Service has exited and closed its end of the pty, or is about to be
+ * restarted.  Closing the pipe to logit makes it exit.
+ */
+void logbuf_close(struct logbuf *lb)
+{
+	if (!lb)
+		return;
+
+	if (lb->fd != -1) {
+		uev_io_stop(&lb->watcher);
+		close(lb->fd);
+		lb->fd = -1;
+	}
+
+	if (lb->lfd != -1) {
+		close(lb->lfd);
+		lb->lfd = -1;
+	}
+}
+
+void logbuf_free(struct logbuf *lb)
+{
+	logbuf_close(lb);
+	free(lb);
+}
+
+void logbuf_append(struct logbuf *lb, const char *buf, size_t len)
+{
+	size_t pos, num;
+
+	if (!lb || !lb->size)
+		return;
+
+	/* Only the tail fits */
+	if (len > lb->size) {
+		lb->total += len - lb->size;
+		buf += len - lb->size;
+		len  = lb->size;
+	}
+
+	while (len > 0) {
+		pos = lb->total % lb->size;
+		num = min(len, lb->size - pos);
+
+		memcpy(&lb->data[pos], buf, num);
+		lb->total += num;
+		buf += num;
+		len -= num;
+	}
+}
+
+/**
+ * logbuf_read - Read buffered output
+ * @lb:     Log buffer
+ * @offset: Offset to read from, updated to the offset of the data read
+ * @buf:    Buffer to read to
+ * @len:    Size of @buf
+ *
+ * If @offset is older than what is still buffered it is moved forward
+ * to the oldest byte available.
+ *
+ * Returns:
+ * Number of bytes read, 0 if there is no new data.
+ */
+size_t logbuf_read(struct logbuf *lb, uint64_t *offset, char *buf, size_t len)
+{
+	uint64_t first;
+	size_t pos, num;
+
+	if (!lb || !lb->size)
+		return 0;
+
+	first = lb->total > lb->size ? lb->total - lb->size : 0;
+	if (*offset < first || *offset > lb->total)
+		*offset = first;
+
+	len = min(len, (size_t)(lb->total - *offset));
+	pos = *offset % lb->size;
+	num = min(len, lb->size - pos);
+
+	memcpy(buf, &lb->data[pos], num);
+	if (num < len)
+		memcpy(&buf[num], lb->data, len - num);
+
+	return len;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
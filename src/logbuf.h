@@ -0,0 +1,83 @@
+/* Per-service in-memory log buffer, last output from each service
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_LOGBUF_H_
+#define FINIT_LOGBUF_H_
+
+#include <stdint.h>
+#include <uev/uev.h>
+
+#include "svc.h"
+
+#define LOGBUF_SIZE   4096	/* Default byte budget per service */
+#define LOGBUF_CHUNK  1024	/* Max payload of one struct logbuf_rec */
+
+/*
+ * The last output from a service with log:buffer, the ring is kept
+ * across restarts of the service.  While the service runs, its output
+ * is read by PID 1 from a pty and forwarded to logit on a pipe.
+ */
+struct logbuf {
+	uev_t    watcher;
+	int      fd;			/* pty master, service output */
+	int      lfd;			/* pipe to logit, or -1 */
+	uint64_t lost;			/* Bytes not sent to logit, not reported yet */
+	uint64_t dropped;		/* Bytes not sent to logit, in total */
+
+	uint64_t total;			/* Bytes ever written */
+	size_t   size;
+	char     data[];
+};
+
+/*
+ * INIT_CMD_SVC_LOG request, sent in init_request.data.  Read buffered
+ * output of a service from @offset, 0 for everything still buffered.
+ * The reply is zero or more struct logbuf_rec, followed by the ACK, or
+ * a NACK if the service does not exist or has no log buffer.
+ */
+struct logbuf_req {
+	uint64_t offset;
+	char     ident[MAX_IDENT_LEN];
+};
+
+struct logbuf_rec {
+	uint64_t offset;		/* Offset of data[0] */
+	uint32_t len;
+	char     data[LOGBUF_CHUNK];
+};
+
+struct logbuf *logbuf_new    (struct logbuf *lb, size_t size);
+void           logbuf_close  (struct logbuf *lb);
+void           logbuf_free   (struct logbuf *lb);
+
+void           logbuf_append (struct logbuf *lb, const char *buf, size_t len);
+size_t         logbuf_read   (struct logbuf *lb, uint64_t *offset, char *buf, size_t len);
+
+#endif /* FINIT_LOGBUF_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,458 @@
+/* Event loop instrumentation, callback latency and stall detection
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"		/* Generated by configure script */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef HAVE_EXECINFO_H
+# include <execinfo.h>
+#endif
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+
+#include "finit.h"
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
+#include "util.h"
+#include "watchdog.h"
+
+#define LOOP_BT_MAX 10		/* Frames, including signal handler */
+
+static TAILQ_HEAD(, probe) probes = TAILQ_HEAD_INITIALIZER(probes);
+
+/*
+ * A one-shot timer is armed when entering the outermost callback.  If
+ * it fires we are stalled, and the signal handler saves a backtrace of
+ * the offending code, which is logged when the callback returns.
+ */
+static timer_t stall_timer;
+static int     has_timer;
+static int     depth;
+
+static volatile sig_atomic_t bt_len;
+static void   *bt[LOOP_BT_MAX];
+
+static void stall_handler(int signo, siginfo_t *info, void *ctx)
+{
+	(void)signo;
+	(void)info;
+	(void)ctx;
+#ifdef HAVE_EXECINFO_H
+	bt_len = backtrace(bt, NELEMS(bt));
+#endif
+}
+
+static void stall_timer_set(int msec)
+{
+	struct itimerspec its = {
+		.it_value.tv_sec  = msec / 1000,
+		.it_value.tv_nsec = (msec % 1000) * 1000000,
+	};
+
+	if (has_timer)
+		timer_settime(stall_timer, 0, &its, NULL);
+}
+
+static void stall_backtrace(void)
+{
+#ifdef HAVE_EXECINFO_H
+	char **sym;
+	int i;
+
+	if (!bt_len)
+		return;
+
+	sym = backtrace_symbols(bt, bt_len);
+	if (sym) {
+		/* Skip ourselves and the signal trampoline */
+		for (i = 2; i < bt_len; i++)
+			logit(LOG_WARNING, "  #%d %s", i - 2, sym[i]);
+		free(sym);
+	}
+#endif
+	bt_len = 0;
+}
+
+/**
+ * loop_probe - Find, or create, a named probe
+ * @name: Name of callback or hook
+ *
+ * Returns:
+ * Pointer to probe, or %NULL if out of memory.
+ */
+struct probe *loop_probe(const char *name)
+{
+	struct probe *p;
+
+	TAILQ_FOREACH(p, &probes, link) {
+		if (!strcmp(p->name, name))
+			return p;
+	}
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+
+	strlcpy(p->name, name, sizeof(p->name));
+	TAILQ_INSERT_TAIL(&probes, p, link);
+
+	return p;
+}
+
+struct probe *loop_iterator(struct probe **iter, int first)
+{
+	struct probe *p;
+
+	if (first)
+		*iter = TAILQ_FIRST(&probes);
+
+	p = *iter;
+	if (p)
+		*iter = TAILQ_NEXT(p, link);
+
+	return p;
+}
+
+/*
+ * One libuEv context per priority class, all of them in one epoll set
+ * we block on.  Classes where a callback may free watchers in the same
+ * class, e.g., a service's timer and log buffer when it is removed, or
+ * other API clients on shutdown, harvest one event at a time.  libuEv
+ * does not know about watchers freed behind a harvested event.
+ */
+static struct {
+	const char      *name;
+	int              maxevents;
+	int              budget;
+	uev_ctx_t        ctx;
+	struct loop_stat stat;
+} classes[LOOP_PRIO_MAX] = {
+	[LOOP_PRIO_SIG]  = { "sig",  LOOP_BATCH_MAX, LOOP_BUDGET     },
+	[LOOP_PRIO_COND] = { "cond", LOOP_BATCH_MAX, LOOP_BUDGET     },
+	[LOOP_PRIO_MAIN] = { "main", 1,              LOOP_BUDGET     },
+	[LOOP_PRIO_API]  = { "api",  1,              LOOP_API_BUDGET },
+};
+static int      top = -1;
+static int      degraded;	/* All classes in the main context */
+static uint64_t dispatched;	/* Outermost callbacks run */
+
+/**
+ * loop_enter - Call before running a callback or hook
+ *
+ * Returns:
+ * Start time, to be passed to loop_leave().
+ */
+uint64_t loop_enter(void)
+{
+	if (depth++ == 0) {
+		stall_timer_set(LOOP_STALL_MSEC);
+		dispatched++;
+	}
+
+	return mono_usec();
+}
+
+/**
+ * loop_leave - Call after a callback or hook has returned
+ * @p:     Probe to account time on, may be %NULL
+ * @start: Return value from loop_enter()
+ *
+ * Updates the probe's histogram and logs the callback if it blocked
+ * the event loop for longer than %LOOP_STALL_MSEC.
+ */
+void loop_leave(struct probe *p, uint64_t start)
+{
+	uint64_t usec, lim;
+	int i;
+
+	usec = mono_usec() - start;
+	if (--depth == 0)
+		stall_timer_set(0);
+
+	if (!p)
+		return;
+
+	p->calls++;
+	p->total += usec;
+	if (usec > p->max)
+		p->max = usec;
+
+	for (i = 0, lim = 10; i < LOOP_HIST_MAX - 1 && usec >= lim; i++)
+		lim *= 10;
+	p->hist[i]++;
+
+	if (usec < LOOP_STALL_MSEC * 1000)
+		return;
+
+	logit(LOG_WARNING, "Event loop stalled %llu ms in %s", (unsigned long long)usec / 1000, p->name);
+	stall_backtrace();
+}
+
+/*
+ * Called after sig_init(), which ignores all signals.  If the timer
+ * cannot be created we still keep latency statistics, but will not be
+ * able to tell where a stalled callback is stuck.
+ */
+void loop_init(void)
+{
+	struct sigevent sev = {
+		.sigev_notify = SIGEV_SIGNAL,
+	};
+	struct sigaction sa = {
+		.sa_sigaction = stall_handler,
+		.sa_flags     = SA_SIGINFO | SA_RESTART,
+	};
+
+#ifdef HAVE_EXECINFO_H
+	/* First call may load libgcc, so not safe in a signal handler */
+	bt_len = backtrace(bt, NELEMS(bt));
+	bt_len = 0;
+#endif
+
+	sev.sigev_signo = SIGRTMIN;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGRTMIN, &sa, NULL)) {
+		_pe("Failed setting up stall detection signal");
+		return;
+	}
+
+	if (timer_create(CLOCK_MONOTONIC, &sev, &stall_timer)) {
+		_pe("Failed creating stall detection timer");
+		return;
+	}
+
+	has_timer = 1;
+}
+
+/**
+ * loop_create - Set up one event context per priority class
+ *
+ * Must be called before any watchers are registered, see loop_ctx().
+ * On error the loop runs degraded, without priority classes, all of
+ * them share the main context.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error.
+ */
+int loop_create(void)
+{
+	int i, rc = 0;
+
+	top = epoll_create1(EPOLL_CLOEXEC);
+	if (top < 0) {
+		_pe("Failed creating event loop");
+		rc = 1;
+	}
+
+	for (i = 0; i < LOOP_PRIO_MAX; i++) {
+		struct epoll_event ev = {
+			.events   = EPOLLIN,
+			.data.u32 = i,
+		};
+
+		if (uev_init1(&classes[i].ctx, classes[i].maxevents)) {
+			_pe("Failed creating %s event context", classes[i].name);
+			rc = 1;
+			continue;
+		}
+
+		if (top >= 0 && epoll_ctl(top, EPOLL_CTL_ADD, classes[i].ctx.fd, &ev)) {
+			_pe("Failed adding %s event context", classes[i].name);
+			rc = 1;
+		}
+	}
+
+	if (rc) {
+		logit(LOG_WARNING, "Event loop degraded, no priority classes.");
+		degraded = 1;
+	}
+
+	return rc;
+}
+
+uev_ctx_t *loop_ctx(int prio)
+{
+	if (prio < 0 || prio >= LOOP_PRIO_MAX || degraded)
+		prio = LOOP_PRIO_MAIN;
+
+	return &classes[prio].ctx;
+}
+
+const char *loop_class(int prio)
+{
+	return classes[prio].name;
+}
+
+struct loop_stat *loop_stat(int prio)
+{
+	return &classes[prio].stat;
+}
+
+/*
+ * Heartbeat to the built-in watchdogd.  Sent from the loop itself, not
+ * a timer, so a PID 1 wedged in a callback or hook, e.g. a blocking
+ * complete(), stops it and the hardware watchdog resets the system.
+ * Nothing listening, e.g., no watchdogd, is not an error.
+ *
+ * Returns:
+ * Milliseconds until the next heartbeat is due.
+ */
+static int heartbeat(void)
+{
+	static struct sockaddr_un sun = {
+		.sun_family = AF_UNIX,
+		.sun_path   = WDT_HEARTBEAT,
+	};
+	static uint64_t last;
+	static int sd = -1;
+	uint64_t now, due;
+	char msg[16];
+	int len;
+
+	now = mono_usec();
+	due = WDT_HEARTBEAT_MSEC * 1000;
+	if (last && now - last < due)
+		return (int)((due - (now - last)) / 1000) + 1;
+
+	metrics.hb_lag = last && now - last > due ? now - last - due : 0;
+	if (metrics.hb_lag > metrics.hb_lag_max)
+		metrics.hb_lag_max = metrics.hb_lag;
+	metrics.heartbeats++;
+	last = now;
+
+	if (sd < 0)
+		sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd >= 0) {
+		/* Tell watchdogd our deadline */
+		len = snprintf(msg, sizeof(msg), "%d", WDT_DEADLINE);
+		if (sendto(sd, msg, len, 0, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+			_d("No watchdogd heartbeat receiver: %s", strerror(errno));
+	}
+
+	return WDT_HEARTBEAT_MSEC;
+}
+
+/*
+ * Drain one class, batch by batch, until it is empty or the budget for
+ * this iteration is spent.  Remaining events are served next iteration,
+ * after all higher priority classes.
+ */
+static int serve(int prio)
+{
+	struct loop_stat *st = &classes[prio].stat;
+	uint64_t n, total = 0;
+
+	do {
+		n = dispatched;
+		if (uev_run(&classes[prio].ctx, UEV_ONCE | UEV_NONBLOCK) < 0)
+			return 1;
+
+		n = dispatched - n;
+		if (!n)
+			return 0;
+
+		st->batches++;
+		st->events += n;
+		if (n > st->max)
+			st->max = n;
+		total += n;
+	} while (total < (uint64_t)classes[prio].budget);
+
+	st->exhausted++;
+
+	return 0;
+}
+
+/* Only wakes up the degraded loop, heartbeat() is called from loop_run() */
+static void tick_cb(uev_t *w, void *arg, int events)
+{
+}
+LOOP_PROBE(tick_cb)
+
+/**
+ * loop_run - Run the event loop
+ *
+ * Every iteration each class is served in priority order, also those
+ * without ready events since libuEv arms timers set up from another
+ * context's callbacks when the owning context is run.  Then a heartbeat
+ * is sent to watchdogd, if due.
+ *
+ * Returns:
+ * Only on unrecoverable error, non-zero.
+ */
+int loop_run(void)
+{
+	struct epoll_event ev[LOOP_PRIO_MAX];
+	uev_t tick;
+	int i, msec;
+
+	/* Degraded, block on main context, tick keeps heartbeat going */
+	if (degraded && uev_timer_init(loop_ctx(LOOP_PRIO_MAIN), &tick, LOOP_CB(tick_cb), NULL,
+				       WDT_HEARTBEAT_MSEC, WDT_HEARTBEAT_MSEC))
+		return 1;
+
+	while (1) {
+		for (i = 0; i < LOOP_PRIO_MAX; i++) {
+			if (degraded && i != LOOP_PRIO_MAIN)
+				continue;
+
+			if (serve(i)) {
+				_e("Unrecoverable error in %s event context", classes[i].name);
+				return 1;
+			}
+		}
+		metrics.loop_iter++;
+		msec = heartbeat();
+
+		if (degraded) {
+			if (uev_run(loop_ctx(LOOP_PRIO_MAIN), UEV_ONCE))
+				return 1;
+			continue;
+		}
+
+		/* Wake up in time for the next heartbeat also when idle */
+		if (epoll_wait(top, ev, NELEMS(ev), msec) < 0 && errno != EINTR) {
+			_pe("Failed waiting for events");
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,114 @@
+/* Event loop instrumentation, callback latency and stall detection
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_LOOP_H_
+#define FINIT_LOOP_H_
+
+#include <stdint.h>
+#ifdef _LIBITE_LITE
+# include <libite/queue.h>	/* BSD sys/queue.h API */
+#else
+# include <lite/queue.h>	/* BSD sys/queue.h API */
+#endif
+#include <uev/uev.h>
+
+#define LOOP_STALL_MSEC  500	/* Log callbacks blocking the loop longer than this */
+#define LOOP_HIST_MAX    8	/* Decades: <10us, <100us, <1ms, ... <10s, >=10s */
+#define LOOP_NAME_LEN    48
+#define LOOP_BATCH_MAX   10	/* Events per epoll_wait(), UEV_MAX_EVENTS in libuEv */
+#define LOOP_BUDGET      64	/* Events per class and loop iteration */
+#define LOOP_API_BUDGET  4	/* Lower for API clients, supervision comes first */
+
+/*
+ * Priority classes, each with its own libuEv context.  Served in this
+ * order every loop iteration.  LOOP_PRIO_MAIN is the global ctx used
+ * for timers and everything not placed elsewhere.
+ */
+enum {
+	LOOP_PRIO_SIG = 0,		/* Signals, i.e., reaping children */
+	LOOP_PRIO_COND,			/* Condition sources, plugin I/O, inotify */
+	LOOP_PRIO_MAIN,			/* Timers, log buffers, ... */
+	LOOP_PRIO_API,			/* initctl clients */
+	LOOP_PRIO_MAX
+};
+
+struct loop_stat {
+	uint64_t batches;		/* Non-empty epoll_wait() */
+	uint64_t events;		/* Callbacks run */
+	uint64_t max;			/* Largest batch */
+	uint64_t exhausted;		/* Iterations the budget ran out */
+};
+
+/*
+ * One probe per callback or hook, sent as-is to initctl.
+ */
+struct probe {
+	TAILQ_ENTRY(probe) link;
+
+	char     name[LOOP_NAME_LEN];
+	uint64_t calls;
+	uint64_t total;			/* usec */
+	uint64_t max;			/* usec */
+	uint64_t hist[LOOP_HIST_MAX];
+};
+
+/*
+ * Wrap a libuEv callback in a probe.  Place LOOP_PROBE(fn) after the
+ * callback and register the watcher with LOOP_CB(fn) instead of fn.
+ */
+#define LOOP_PROBE(fn)							\
+	static void fn##_probe(uev_t *w, void *arg, int events)	\
+	{								\
+		static struct probe *p;					\
+		uint64_t start;						\
+									\
+		if (!p)							\
+			p = loop_probe(#fn);				\
+		start = loop_enter();					\
+		fn(w, arg, events);					\
+		loop_leave(p, start);					\
+	}
+#define LOOP_CB(fn) fn##_probe
+
+struct probe *loop_probe    (const char *name);
+struct probe *loop_iterator (struct probe **iter, int first);
+
+uint64_t      loop_enter    (void);
+void          loop_leave    (struct probe *p, uint64_t start);
+
+void          loop_init     (void);
+
+int           loop_create   (void);
+uev_ctx_t    *loop_ctx      (int prio);
+const char   *loop_class    (int prio);
+struct loop_stat *loop_stat (int prio);
+int           loop_run      (void);
+
+#endif /* FINIT_LOOP_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,12 +21,21 @@
  * THE SOFTWARE.
  */
 
+#include <fcntl.h>
 #include <glob.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "helpers.h"
+#include "log.h"
+#include "util.h"
 
+#define MDADM_POOL     4	/* Arrays quiesced in parallel */
+#define MDADM_TIMEOUT  30	/* sec, for all arrays */
+#define MDADM_POLL     50000	/* usec */
 
 static glob_t *get_arrays(void)
 {
@@ -39,29 +48,142 @@ static glob_t *get_arrays(void)
 	return NULL;
 }
 
+/*
+ * Arrays that are clean, read-only, or stopped have nothing to flush,
+ * no need to fork mdadm for them.  If we cannot tell, ask mdadm.
+ */
+static int is_clean(const char *sysfs)
+{
+	const char *clean[] = { "clean", "readonly", "read-auto", "inactive", "clear", NULL };
+	char path[256], state[32];
+	size_t i;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/md/array_state", sysfs);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+
+	if (!fgets(state, sizeof(state), fp)) {
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	chomp(state);
+	for (i = 0; clean[i]; i++) {
+		if (!strcmp(state, clean[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+static pid_t wait_clean(const char *array)
+{
+	char dev[64];
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		int fd;
+
+		fd = open("/dev/null", O_WRONLY);
+		if (fd != -1) {
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+		}
+
+		snprintf(dev, sizeof(dev), "/dev/%s", array);
+		execlp("mdadm", "mdadm", "--wait-clean", dev, NULL);
+		_exit(1);
+	}
+
+	return pid;
+}
+
 /*
  * If system has an MD raid, we must tell it to stop before continuing
  * with the shutdown.  Some controller cards, in particular the Intel(R)
  * Matrix Storage Manager, must be properly notified.
+ *
+ * Arrays are marked clean, MDADM_POOL at a time, and we give up on all
+ * that remain after MDADM_TIMEOUT sec.
  */
 void mdadm_wait(void)
 {
-	size_t i;
+	pid_t pids[MDADM_POOL] = { 0 };
+	char *names[MDADM_POOL];
+	int timeout = MDADM_TIMEOUT * 1000000 / MDADM_POLL;
+	int running = 0, spawned = 0, failed = 0;
+	size_t i, next = 0;
 	glob_t *gl;
-	char cmd[160];
 
-	/* Setup kernel specific settings, e.g. allow broadcast ping, etc. */
 	gl = get_arrays();
-	if (gl) {
-		for (i = 0; i < gl->gl_pathc; i++) {
-			char *array;
+	if (!gl)
+		return;
+
+	while (next < gl->gl_pathc || running > 0) {
+		/* Fill the pool */
+		for (i = 0; i < MDADM_POOL; i++) {
+			while (!pids[i] && next < gl->gl_pathc) {
+				char *sysfs = gl->gl_pathv[next++];
+
+				if (is_clean(sysfs)) {
+					_d("MD array %s already clean", basename(sysfs));
+					continue;
+				}
+
+				names[i] = basename(sysfs);
+				pids[i]  = wait_clean(names[i]);
+				if (pids[i] <= 0) {
+					pids[i] = 0;
+					failed++;
+					continue;
+				}
+				running++;
+				spawned++;
+			}
+		}
 
-			array = basename(gl->gl_pathv[i]);
-			snprintf(cmd, sizeof(cmd), "mdadm --wait-clean /dev/%s >/dev/null", array);
-			run_interactive(cmd, "Marking MD array %s as clean", array);
+		for (i = 0; i < MDADM_POOL; i++) {
+			int status;
+
+			if (!pids[i] || waitpid(pids[i], &status, WNOHANG) != pids[i])
+				continue;
+
+			if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+				logit(LOG_WARNING, "Failed marking MD array %s as clean", names[i]);
+				failed++;
+			}
+			pids[i] = 0;
+			running--;
 		}
-		globfree(gl);
+
+		if (!running)
+			continue;
+
+		if (timeout-- <= 0) {
+			for (i = 0; i < MDADM_POOL; i++) {
+				if (!pids[i])
+					continue;
+
+				logit(LOG_WARNING, "Timeout marking MD array %s as clean", names[i]);
+				kill(pids[i], SIGKILL);
+				waitpid(pids[i], NULL, 0);
+			}
+			failed += running + (gl->gl_pathc - next);
+			break;
+		}
+
+		do_usleep(MDADM_POLL);
+	}
+
+	if (spawned || failed) {
+		print_desc("Marking MD arrays as clean", NULL);
+		print_result(failed);
 	}
+	globfree(gl);
 }
 
 /**
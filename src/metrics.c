@@ -0,0 +1,316 @@
+/* Counters and gauges for PID 1 internals, Prometheus text export
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <inttypes.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+#else
+# include <lite/lite.h>
+#endif
+#include <uev/uev.h>
+
+#include "finit.h"
+#include "cond.h"
+#include "log.h"
+#include "logbuf.h"
+#include "loop.h"
+#include "metrics.h"
+#include "util.h"
+
+#define METRICS_TMP  METRICS_FILE "+"
+
+struct metrics metrics;
+int metrics_interval = 0;	/* msec, 0: disabled */
+
+enum {
+	SVC_STARTS,
+	SVC_CRASHES,
+	SVC_RESTARTS,
+	SVC_STATES,
+	SVC_LOG_DROPPED,
+};
+
+static uint64_t reload_start;
+
+static const char *state_names[] = {
+	[SVC_HALTED_STATE]   = "halted",
+	[SVC_DONE_STATE]     = "done",
+	[SVC_STOPPING_STATE] = "stopping",
+	[SVC_CLEANUP_STATE]  = "cleanup",
+	[SVC_SETUP_STATE]    = "setup",
+	[SVC_WAITING_STATE]  = "waiting",
+	[SVC_READY_STATE]    = "ready",
+	[SVC_RUNNING_STATE]  = "running",
+};
+
+/**
+ * metrics_api - Account for one served API request
+ * @start: mono_usec() when the request was received
+ */
+void metrics_api(uint64_t start)
+{
+	metrics.api_requests++;
+	metrics.api_usec += mono_usec() - start;
+}
+
+void metrics_reload_begin(void)
+{
+	reload_start = mono_usec();
+}
+
+void metrics_reload_end(void)
+{
+	if (!reload_start)
+		return;
+
+	metrics.reload_last  = mono_usec() - reload_start;
+	metrics.reload_usec += metrics.reload_last;
+	metrics.reloads++;
+	reload_start = 0;
+}
+
+/**
+ * metrics_svc_state - Account time spent in the current state
+ * @svc:  Service about to change state
+ * @next: The new state
+ *
+ * Called from svc_set_state() on every transition, including the
+ * no-op ones, which only moves the time stamp forward.
+ */
+void metrics_svc_state(svc_t *svc, svc_state_t next)
+{
+	uint64_t now = mono_usec();
+
+	(void)next;
+	if (svc->state_ts && svc->state < NELEMS(svc->state_usec))
+		svc->state_usec[svc->state] += now - svc->state_ts;
+	svc->state_ts = now;
+}
+
+static void header(FILE *fp, const char *name, const char *type, const char *help)
+{
+	fprintf(fp, "# HELP %s %s\n", name, help);
+	fprintf(fp, "# TYPE %s %s\n", name, type);
+}
+
+static double seconds(uint64_t usec)
+{
+	return (double)usec / 1000000.0;
+}
+
+/*
+ * All per-service metrics share the same label set, to make it easy
+ * to join them in queries.  Names and instance IDs are single .conf
+ * tokens, so they are used as-is without escaping.
+ */
+static void per_svc(FILE *fp, const char *name, int what)
+{
+	svc_t *svc, *iter = NULL;
+	uint64_t now = mono_usec();
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		const char *type = svc_typestr(svc);
+		size_t i;
+
+		switch (what) {
+		case SVC_STARTS:
+			fprintf(fp, "%s{name=\"%s\",id=\"%s\",type=\"%s\"} %u\n",
+				name, svc->name, svc->id, type, svc->start_cnt);
+			break;
+
+		case SVC_CRASHES:
+			fprintf(fp, "%s{name=\"%s\",id=\"%s\",type=\"%s\"} %u\n",
+				name, svc->name, svc->id, type, svc->crash_cnt);
+			break;
+
+		case SVC_RESTARTS:
+			fprintf(fp, "%s{name=\"%s\",id=\"%s\",type=\"%s\"} %u\n",
+				name, svc->name, svc->id, type, svc->restart_tot);
+			break;
+
+		case SVC_STATES:
+			for (i = 0; i < NELEMS(state_names); i++) {
+				uint64_t usec = svc->state_usec[i];
+
+				if (svc->state == i && svc->state_ts)
+					usec += now - svc->state_ts;
+
+				fprintf(fp, "%s{name=\"%s\",id=\"%s\",type=\"%s\",state=\"%s\"} %.3f\n",
+					name, svc->name, svc->id, type, state_names[i], seconds(usec));
+			}
+			break;
+
+		case SVC_LOG_DROPPED:
+			if (!svc->logbuf)
+				break;
+			fprintf(fp, "%s{name=\"%s\",id=\"%s\",type=\"%s\"} %" PRIu64 "\n",
+				name, svc->name, svc->id, type, svc->logbuf->dropped);
+			break;
+		}
+	}
+}
+
+/*
+ * Render to a temporary file on the same tmpfs and rename it into
+ * place, a scraper will never see a half-written file.
+ */
+static int render(void)
+{
+	uint64_t suppressed;
+	char *name;
+	FILE *fp;
+	int i;
+
+	fp = fopen(METRICS_TMP, "w");
+	if (!fp) {
+		_pe("Failed opening %s", METRICS_TMP);
+		return 1;
+	}
+
+	header(fp, "finit_loop_iterations_total", "counter", "Event loop iterations.");
+	fprintf(fp, "finit_loop_iterations_total %" PRIu64 "\n", metrics.loop_iter);
+
+	header(fp, "finit_loop_events_total", "counter", "Callbacks run, per priority class.");
+	for (i = 0; i < LOOP_PRIO_MAX; i++)
+		fprintf(fp, "finit_loop_events_total{class=\"%s\"} %" PRIu64 "\n", loop_class(i), loop_stat(i)->events);
+
+	header(fp, "finit_loop_batches_total", "counter", "Non-empty event batches, per priority class.");
+	for (i = 0; i < LOOP_PRIO_MAX; i++)
+		fprintf(fp, "finit_loop_batches_total{class=\"%s\"} %" PRIu64 "\n", loop_class(i), loop_stat(i)->batches);
+
+	header(fp, "finit_loop_batch_max", "gauge", "Largest event batch, per priority class.");
+	for (i = 0; i < LOOP_PRIO_MAX; i++)
+		fprintf(fp, "finit_loop_batch_max{class=\"%s\"} %" PRIu64 "\n", loop_class(i), loop_stat(i)->max);
+
+	header(fp, "finit_loop_budget_exhausted_total", "counter", "Iterations a priority class had events left after its budget.");
+	for (i = 0; i < LOOP_PRIO_MAX; i++)
+		fprintf(fp, "finit_loop_budget_exhausted_total{class=\"%s\"} %" PRIu64 "\n", loop_class(i), loop_stat(i)->exhausted);
+
+	header(fp, "finit_reaps_total", "counter", "Child processes collected.");
+	fprintf(fp, "finit_reaps_total %" PRIu64 "\n", metrics.reaps);
+
+	header(fp, "finit_cond_transitions_total", "counter", "Condition state changes.");
+	fprintf(fp, "finit_cond_transitions_total %" PRIu64 "\n", metrics.cond_transitions);
+
+	header(fp, "finit_cond_suppressed_total", "counter", "Condition changes that did not outlast their settle time.");
+	for (int first = 1; cond_settle_iterator(&name, &suppressed, first); first = 0)
+		fprintf(fp, "finit_cond_suppressed_total{cond=\"%s\"} %" PRIu64 "\n", name, suppressed);
+
+	header(fp, "finit_api_request_duration_seconds", "summary", "Time spent serving initctl requests.");
+	fprintf(fp, "finit_api_request_duration_seconds_sum %.6f\n", seconds(metrics.api_usec));
+	fprintf(fp, "finit_api_request_duration_seconds_count %" PRIu64 "\n", metrics.api_requests);
+
+	header(fp, "finit_reload_duration_seconds", "summary", "Time spent reloading configuration.");
+	fprintf(fp, "finit_reload_duration_seconds_sum %.6f\n", seconds(metrics.reload_usec));
+	fprintf(fp, "finit_reload_duration_seconds_count %" PRIu64 "\n", metrics.reloads);
+
+	header(fp, "finit_reload_last_duration_seconds", "gauge", "Duration of the last reload.");
+	fprintf(fp, "finit_reload_last_duration_seconds %.6f\n", seconds(metrics.reload_last));
+
+	header(fp, "finit_heartbeats_total", "counter", "Event loop heartbeats sent to the watchdog.");
+	fprintf(fp, "finit_heartbeats_total %" PRIu64 "\n", metrics.heartbeats);
+
+	header(fp, "finit_heartbeat_lag_seconds", "gauge", "How late the last heartbeat was.");
+	fprintf(fp, "finit_heartbeat_lag_seconds %.6f\n", seconds(metrics.hb_lag));
+
+	header(fp, "finit_heartbeat_lag_max_seconds", "gauge", "Largest heartbeat lag since boot.");
+	fprintf(fp, "finit_heartbeat_lag_max_seconds %.6f\n", seconds(metrics.hb_lag_max));
+
+	header(fp, "finit_runlevel", "gauge", "Current runlevel.");
+	fprintf(fp, "finit_runlevel %d\n", runlevel);
+
+	header(fp, "finit_service_starts_total", "counter", "Number of times a service has been started.");
+	per_svc(fp, "finit_service_starts_total", SVC_STARTS);
+
+	header(fp, "finit_service_crashes_total", "counter", "Number of times a service has died unexpectedly.");
+	per_svc(fp, "finit_service_crashes_total", SVC_CRASHES);
+
+	header(fp, "finit_service_restarts_total", "counter", "Number of times a service has been restarted.");
+	per_svc(fp, "finit_service_restarts_total", SVC_RESTARTS);
+
+	header(fp, "finit_service_state_seconds_total", "counter", "Time a service has spent in each state.");
+	per_svc(fp, "finit_service_state_seconds_total", SVC_STATES);
+
+	header(fp, "finit_service_log_dropped_bytes_total", "counter", "Buffered service output not passed on to the logger.");
+	per_svc(fp, "finit_service_log_dropped_bytes_total", SVC_LOG_DROPPED);
+
+	if (fclose(fp)) {
+		_pe("Failed writing %s", METRICS_TMP);
+		goto fail;
+	}
+
+	if (rename(METRICS_TMP, METRICS_FILE)) {
+		_pe("Failed installing %s", METRICS_FILE);
+		goto fail;
+	}
+
+	return 0;
+fail:
+	erase(METRICS_TMP);
+	return 1;
+}
+
+static void metrics_cb(uev_t *w, void *arg, int events)
+{
+	(void)arg;
+	if (UEV_ERROR == events) {
+		uev_timer_start(w);
+		return;
+	}
+
+	render();
+}
+LOOP_PROBE(metrics_cb)
+
+/*
+ * Called at boot and after every .conf reload, metrics-interval may
+ * have changed or been removed
+ */
+void metrics_init(void)
+{
+	static int initialized = 0;
+	static uev_t watcher;
+
+	if (!metrics_interval) {
+		if (initialized) {
+			uev_timer_stop(&watcher);
+			erase(METRICS_FILE);
+		}
+		return;
+	}
+
+	if (!initialized) {
+		uev_timer_init(ctx, &watcher, LOOP_CB(metrics_cb), NULL, metrics_interval, metrics_interval);
+		initialized = 1;
+	} else
+		uev_timer_set(&watcher, metrics_interval, metrics_interval);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
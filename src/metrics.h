@@ -0,0 +1,69 @@
+/* Counters and gauges for PID 1 internals, Prometheus text export
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_METRICS_H_
+#define FINIT_METRICS_H_
+
+#include <paths.h>
+#include <stdint.h>
+
+#include "svc.h"
+
+#define METRICS_FILE  _PATH_VARRUN "finit/metrics.prom"
+
+/* Global counters, per-service counters are kept in svc_t */
+struct metrics {
+	uint64_t loop_iter;		/* Event loop iterations */
+	uint64_t reaps;			/* Children collected by SIGCHLD handler */
+	uint64_t cond_transitions;	/* Condition changed state */
+
+	uint64_t api_requests;		/* initctl requests served */
+	uint64_t api_usec;		/* Total time spent serving them */
+
+	uint64_t reloads;		/* Completed reloads (reconf) */
+	uint64_t reload_usec;		/* Total time spent in reloads */
+	uint64_t reload_last;		/* Duration of last reload */
+
+	uint64_t heartbeats;		/* Sent to watchdogd */
+	uint64_t hb_lag;		/* How late the last heartbeat was, usec */
+	uint64_t hb_lag_max;		/* Latest heartbeat so far, usec */
+};
+
+extern struct metrics metrics;
+extern int metrics_interval;
+
+void metrics_api          (uint64_t start);
+void metrics_reload_begin (void);
+void metrics_reload_end   (void);
+void metrics_svc_state    (svc_t *svc, svc_state_t next);
+
+void metrics_init         (void);
+
+#endif /* FINIT_METRICS_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,9 +21,32 @@
  * THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <mntent.h>
+#include <unistd.h>
 #include <sys/mount.h>
+#include <sys/swap.h>
+#include <sys/wait.h>
+
+#include "log.h"
+
+/*
+ * One entry from /proc/self/mountinfo.  The mount and parent IDs give
+ * us the tree, so a mount is always unmounted before its parent.
+ */
+struct mnt {
+	int   id, parent;
+	int   depth;
+	char *dir;
+	char *type;
+	char *source;
+};
+
+static struct mnt *mnts;
+static size_t      num_mnts;
 
 /*
  * SysV init on Debian/Ubuntu skips these protected mount points
@@ -59,53 +82,260 @@ static int is_protected(char *dir)
 	return 0;
 }
 
-static void iterator_end(FILE **fp)
+/* Backed by a block device, i.e., something to sync and remount ro */
+static int is_block(struct mnt *m)
 {
-	endmntent(*fp);
-	*fp = NULL;
+	return m->source[0] == '/';
 }
 
-static struct mntent *iterator(char *fstab, FILE **fp)
+/* Paths in mountinfo and swaps have space, tab, etc. as octal \040 */
+static char *unescape(char *str)
 {
-	static struct mntent *mnt;
+	char *src = str, *dst = str;
 
-	if (!*fp && fstab) {
-		*fp = setmntent(fstab, "r");
-		if (!*fp)
-			return NULL;
+	while (*src) {
+		if (src[0] == '\\' && src[1] >= '0' && src[1] <= '3' &&
+		    src[2] >= '0' && src[2] <= '7' && src[3] >= '0' && src[3] <= '7') {
+			*dst++ = (src[1] - '0') << 6 | (src[2] - '0') << 3 | (src[3] - '0');
+			src += 4;
+			continue;
+		}
+		*dst++ = *src++;
 	}
+	*dst = 0;
+
+	return str;
+}
+
+static int by_id(const void *a, const void *b)
+{
+	return ((const struct mnt *)a)->id - ((const struct mnt *)b)->id;
+}
 
-	while ((mnt = getmntent(*fp))) {
-		if (is_protected(mnt->mnt_dir))
+/* Deepest first, and for mounts stacked on the same dir, latest first */
+static int by_depth(const void *a, const void *b)
+{
+	const struct mnt *x = a, *y = b;
+
+	if (x->depth != y->depth)
+		return y->depth - x->depth;
+
+	return y->id - x->id;
+}
+
+static int depth(struct mnt *m)
+{
+	struct mnt key, *p;
+
+	if (m->depth >= 0)
+		return m->depth;
+
+	/* The root has a parent outside our namespace */
+	key.id = m->parent;
+	p = bsearch(&key, mnts, num_mnts, sizeof(*mnts), by_id);
+
+	/* Set before recursing, in case of a bogus loop in the table */
+	m->depth = 0;
+	if (p && p != m)
+		m->depth = depth(p) + 1;
+
+	return m->depth;
+}
+
+static void mnt_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < num_mnts; i++) {
+		free(mnts[i].dir);
+		free(mnts[i].type);
+		free(mnts[i].source);
+	}
+	free(mnts);
+	mnts = NULL;
+	num_mnts = 0;
+}
+
+/*
+ * Read the mount table once, sorted in the order to unmount it, the
+ * old way of restarting from the top after each umount was O(n^2).
+ */
+static int mnt_read(void)
+{
+	char line[1024];
+	size_t i, len = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/mountinfo", "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char dir[512], type[64], source[256];
+		int id, parent;
+		struct mnt *m;
+		char *sep;
+
+		sep = strstr(line, " - ");
+		if (!sep)
 			continue;
 
-		return mnt;
+		if (sscanf(line, "%d %d %*s %*s %511s", &id, &parent, dir) != 3 ||
+		    sscanf(sep, " - %63s %255s", type, source) != 2)
+			continue;
+
+		if (num_mnts == len) {
+			len = len ? len * 2 : 64;
+			m = realloc(mnts, len * sizeof(*mnts));
+			if (!m)
+				break;
+			mnts = m;
+		}
+
+		m = &mnts[num_mnts];
+		m->id     = id;
+		m->parent = parent;
+		m->depth  = -1;
+		m->dir    = strdup(unescape(dir));
+		m->type   = strdup(type);
+		m->source = strdup(unescape(source));
+		if (!m->dir || !m->type || !m->source) {
+			free(m->dir);
+			free(m->type);
+			free(m->source);
+			break;
+		}
+		num_mnts++;
 	}
+	fclose(fp);
 
-	iterator_end(fp);
-	return NULL;
+	qsort(mnts, num_mnts, sizeof(*mnts), by_id);
+	for (i = 0; i < num_mnts; i++)
+		depth(&mnts[i]);
+	qsort(mnts, num_mnts, sizeof(*mnts), by_depth);
+
+	return 0;
 }
 
-void unmount_tmpfs(void)
+static void unmount(int tmpfs)
 {
-	struct mntent *mnt;
-	FILE *fp = NULL;
+	size_t i;
+
+	if (mnt_read())
+		return;
 
-	while ((mnt = iterator("/proc/mounts", &fp))) {
-		if (!strcmp("tmpfs", mnt->mnt_fsname) && !umount(mnt->mnt_dir))
-			iterator_end(&fp);  /* Restart iteration */
+	for (i = 0; i < num_mnts; i++) {
+		struct mnt *m = &mnts[i];
+
+		if (is_protected(m->dir))
+			continue;
+		if (tmpfs && strcmp(m->type, "tmpfs"))
+			continue;
+
+		if (umount(m->dir))
+			_d("Failed unmounting %s: %s", m->dir, strerror(errno));
 	}
+
+	mnt_free();
+}
+
+void unmount_tmpfs(void)
+{
+	unmount(1);
 }
 
 void unmount_regular(void)
 {
-	struct mntent *mnt;
-	FILE *fp = NULL;
+	unmount(0);
+}
+
+/*
+ * Same as swapoff -e -a, devices that have gone missing are skipped
+ */
+void swapoff_all(void)
+{
+	char line[512];
+	FILE *fp;
+
+	fp = fopen("/proc/swaps", "r");
+	if (!fp)
+		return;
+
+	/* Skip header */
+	if (!fgets(line, sizeof(line), fp)) {
+		fclose(fp);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char path[256];
+
+		if (sscanf(line, "%255s", path) != 1)
+			continue;
+
+		unescape(path);
+		if (swapoff(path) && errno != ENOENT)
+			_pe("Failed swapoff %s", path);
+	}
+
+	fclose(fp);
+}
+
+/*
+ * Flush all remaining filesystems, one child per filesystem so a slow
+ * device does not hold up the others, then remount them read-only,
+ * including /, which we sit on and cannot unmount.
+ */
+void remount_ro(void)
+{
+	size_t i, num = 0;
+	pid_t *pids;
 
-	while ((mnt = iterator("/proc/mounts", &fp))) {
-		if (!umount(mnt->mnt_dir))
-			iterator_end(&fp);  /* Restart iteration */
+	if (mnt_read()) {
+		sync();
+		mount(NULL, "/", NULL, MS_REMOUNT | MS_RDONLY, NULL);
+		return;
 	}
+
+	pids = calloc(num_mnts, sizeof(pid_t));
+	for (i = 0; pids && i < num_mnts; i++) {
+		struct mnt *m = &mnts[i];
+		pid_t pid;
+
+		if (!is_block(m))
+			continue;
+
+		pid = fork();
+		if (pid == 0) {
+			int fd;
+
+			fd = open(m->dir, O_RDONLY | O_DIRECTORY);
+			if (fd != -1)
+				syncfs(fd);
+			_exit(0);
+		}
+		if (pid > 0)
+			pids[num++] = pid;
+	}
+
+	for (i = 0; i < num; i++)
+		waitpid(pids[i], NULL, 0);
+	free(pids);
+
+	/* Anything we could not fork for, or not backed by a device */
+	sync();
+
+	for (i = 0; i < num_mnts; i++) {
+		struct mnt *m = &mnts[i];
+
+		if (!is_block(m) && strcmp(m->dir, "/"))
+			continue;
+
+		if (mount(NULL, m->dir, NULL, MS_REMOUNT | MS_RDONLY, NULL))
+			_d("Failed remounting %s read-only: %s", m->dir, strerror(errno));
+	}
+
+	mnt_free();
 }
 
 /**
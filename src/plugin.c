@@ -24,8 +24,11 @@
 #include <errno.h>
 #include <dlfcn.h>		/* dlopen() et al */
 #include <dirent.h>		/* readdir() et al */
+#include <limits.h>
 #include <poll.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 # include <libite/queue.h>	/* BSD sys/queue.h API */
@@ -38,9 +41,11 @@
 #include "cond.h"
 #include "finit.h"
 #include "helpers.h"
+#include "loop.h"
 #include "plugin.h"
 #include "private.h"
 #include "service.h"
+#include "util.h"
 
 #define is_io_plugin(p) ((p)->io.cb && (p)->io.fd > 0)
 #define SEARCH_PLUGIN(str)						\
@@ -49,8 +54,27 @@
 			return p;					\
 	}
 
+#define ASYNC_DEPTH 8		/* Max .depends chain for async levels */
+
+/*
+ * An async hook runs in a helper process.  Hooks at the same point run
+ * in parallel levels, a hook is started when all async hooks of the
+ * plugins it depends on have completed.
+ */
+struct job {
+	TAILQ_ENTRY(job) link;
+
+	plugin_t     *p;
+	hook_point_t  no;
+	void         *arg;
+	int           level;
+	pid_t         pid;
+	uint64_t      start;
+};
+
 static char *plugpath = NULL; /* Set by first load. */
 static TAILQ_HEAD(plugin_head, plugin) plugins  = TAILQ_HEAD_INITIALIZER(plugins);
+static TAILQ_HEAD(, job) jobs = TAILQ_HEAD_INITIALIZER(jobs);
 
 #ifndef ENABLE_STATIC
 static void check_plugin_depends(plugin_t *plugin);
@@ -194,18 +218,210 @@ int plugin_exists(hook_point_t no)
 	return 0;
 }
 
-/* Some hooks are called with a fixed argument */
+/*
+ * Async hooks of a hook point still running, or waiting for a level
+ * below them to complete.
+ */
+int plugin_pending(hook_point_t no)
+{
+	struct job *job;
+	int num = 0;
+
+	TAILQ_FOREACH(job, &jobs, link) {
+		if (job->no == no)
+			num++;
+	}
+
+	return num;
+}
+
+static int is_async(plugin_t *p, hook_point_t no)
+{
+	return p->hook[no].cb && p->hook[no].async;
+}
+
+static int async_level(plugin_t *p, hook_point_t no, int depth)
+{
+	int i, level = 0;
+
+	if (depth > ASYNC_DEPTH)
+		return level;
+
+	for (i = 0; i < PLUGIN_DEP_MAX && p->depends[i]; i++) {
+		plugin_t *dep;
+
+		dep = plugin_find(p->depends[i]);
+		if (!dep || !is_async(dep, no))
+			continue;
+
+		level = max(level, 1 + async_level(dep, no, depth + 1));
+	}
+
+	return level;
+}
+
+static void async_add(plugin_t *p, hook_point_t no, void *arg)
+{
+	struct job *job;
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		p->hook[no].cb(arg);
+		return;
+	}
+
+	job->p     = p;
+	job->no    = no;
+	job->arg   = arg;
+	job->level = async_level(p, no, 0);
+	TAILQ_INSERT_TAIL(&jobs, job, link);
+}
+
+/*
+ * The child must not touch the event loop, it only runs the hook.
+ * Progress is disabled, it would garble the output of PID 1.
+ */
+static void async_run(struct job *job)
+{
+	pid_t pid;
+
+	_d("Starting async %s hook %s, level %d", basename(job->p->name), hook_cond[job->no], job->level);
+	job->start = mono_usec();
+
+	pid = fork();
+	if (pid == -1) {
+		_pe("Failed forking %s hook, calling synchronously", basename(job->p->name));
+		job->p->hook[job->no].cb(job->arg);
+		job->pid = -1;
+		return;
+	}
+
+	if (pid == 0) {
+		enable_progress(0);
+		job->p->hook[job->no].cb(job->arg);
+		_exit(0);
+	}
+
+	job->pid = pid;
+}
+
+static void async_done(hook_point_t no)
+{
+	_d("All async %s hooks done", hook_cond[no]);
+	if (no >= HOOK_MOUNT_ERROR)
+		cond_set_oneshot(hook_cond[no]);
+
+	service_step_all(SVC_TYPE_RUNTASK);
+}
+
+/*
+ * Start all hooks in the lowest level not yet completed.  If they all
+ * had to be called synchronously, move on to the next level.
+ */
+static void async_start(hook_point_t no)
+{
+	struct job *job, *tmp;
+	int level, running;
+
+	do {
+		level = INT_MAX;
+		TAILQ_FOREACH(job, &jobs, link) {
+			if (job->no == no)
+				level = min(level, job->level);
+		}
+
+		if (level == INT_MAX) {
+			async_done(no);
+			return;
+		}
+
+		running = 0;
+		TAILQ_FOREACH_SAFE(job, &jobs, link, tmp) {
+			if (job->no != no || job->level != level)
+				continue;
+
+			if (!job->pid)
+				async_run(job);
+			if (job->pid == -1) {
+				TAILQ_REMOVE(&jobs, job, link);
+				free(job);
+				continue;
+			}
+			running++;
+		}
+	} while (!running);
+}
+
+/**
+ * plugin_reap - Collect helper process of an async hook
+ * @pid:    Process ID of collected child
+ * @status: Exit status from waitpid()
+ *
+ * Returns:
+ * %TRUE(1) if @pid was an async hook, otherwise %FALSE(0).
+ */
+int plugin_reap(pid_t pid, int status)
+{
+	struct job *job;
+	hook_point_t no;
+
+	TAILQ_FOREACH(job, &jobs, link) {
+		if (job->pid == pid)
+			break;
+	}
+	if (!job)
+		return 0;
+
+	no = job->no;
+	_d("Async %s hook %s done in %llu ms, status %d", basename(job->p->name), hook_cond[no],
+	   (unsigned long long)(mono_usec() - job->start) / 1000, status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		logit(LOG_WARNING, "Plugin %s hook %s failed", basename(job->p->name), hook_cond[no]);
+
+	TAILQ_REMOVE(&jobs, job, link);
+	free(job);
+
+	async_start(no);
+
+	return 1;
+}
+
+/*
+ * Some hooks are called with a fixed argument.  Async hooks are started
+ * after all synchronous hooks, and the hook condition is set when the
+ * last of them completes.  A synchronous hook cannot depend on an async
+ * one.
+ */
 void plugin_run_hook(hook_point_t no, void *arg)
 {
 	plugin_t *p, *tmp;
+	int async = 0;
 
 	PLUGIN_ITERATOR(p, tmp) {
+		if (is_async(p, no)) {
+			async_add(p, no, arg ? arg : p->hook[no].arg);
+			async++;
+			continue;
+		}
+
 		if (p->hook[no].cb) {
+			char name[LOOP_NAME_LEN];
+			uint64_t start;
+
 			_d("Calling %s hook n:o %d (arg: %p) ...", basename(p->name), no, arg ?: "NIL");
+			snprintf(name, sizeof(name), "%s:%s", basename(p->name), hook_cond[no]);
+
+			start = loop_enter();
 			p->hook[no].cb(arg ? arg : p->hook[no].arg);
+			loop_leave(loop_probe(name), start);
 		}
 	}
 
+	if (async) {
+		async_start(no);
+		return;
+	}
+
 	/* Conditions are stored in /run, so don't try to signal
 	 * conditions for any hooks before filesystems have been
 	 * mounted. */
@@ -231,11 +447,18 @@ static void generic_io_cb(uev_t *w, void *arg, int events)
 	plugin_t *p = (plugin_t *)arg;
 
 	if (is_io_plugin(p) && p->io.fd == w->fd) {
+		char name[LOOP_NAME_LEN];
+		uint64_t start;
+
 		/* Stop watcher, callback may close descriptor on us ... */
 		uev_io_stop(w);
 
 		_d("Calling I/O %s from runloop...", basename(p->name));
+		snprintf(name, sizeof(name), "%s:io", basename(p->name));
+
+		start = loop_enter();
 		p->io.cb(p->io.arg, w->fd, events);
+		loop_leave(loop_probe(name), start);
 
 		/* Update fd, may be changed by plugin callback, e.g., if FIFO */
 		uev_io_set(w, p->io.fd, p->io.flags);
@@ -248,7 +471,7 @@ int plugin_io_init(plugin_t *p)
 		return 0;
 
 	_d("Initializing plugin %s for I/O", basename(p->name));
-	if (uev_io_init(ctx, &p->watcher, generic_io_cb, p, p->io.fd, p->io.flags)) {
+	if (uev_io_init(loop_ctx(LOOP_PRIO_COND), &p->watcher, generic_io_cb, p, p->io.fd, p->io.flags)) {
 		_e("Failed setting up I/O plugin %s", basename(p->name));
 		return 1;
 	}
@@ -82,6 +82,9 @@
 								\
 	/* Shutdown hooks, runlevel [06] */			\
 	CHOOSE(HOOK_SHUTDOWN,        "hook/sys/shutdown"),	\
+								\
+	/* Re-exec hook, instead of bootstrap hooks */		\
+	CHOOSE(HOOK_RESUME,          "nop"),			\
 	CHOOSE(HOOK_MAX_NUM,         "nop")			\
 }
 
@@ -113,6 +116,14 @@ typedef enum HOOK_TYPES hook_point_t;
  * It is up to the external service plugin to track these events and
  * relay them to each @dynamic service plugins' callback.  I.e., to
  * all those with the dynamic flag set.
+ *
+ * A hook with @async set is called in a helper process, in parallel
+ * with other async hooks at the same hook point, after the plugins it
+ * depends on have completed theirs.  The hook condition is set when
+ * all have completed.  Bootstrap, runlevel S, does not start until all
+ * async HOOK_BASEFS_UP hooks have completed.  Async hooks must not
+ * change the state of Finit, e.g., register services or set conditions,
+ * only the system.
  */
 typedef struct plugin {
 	/* BSD sys/queue.h linked list node. */
@@ -131,6 +142,7 @@ typedef struct plugin {
 	struct {
 		void  *arg;      /* Optional argument to callback func. */
 		void (*cb)(void *arg);
+		int    async;    /* Run in helper process, see below. */
 	} hook[HOOK_MAX_NUM];
 
 	/* I/O Plugin */
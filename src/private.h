@@ -33,13 +33,22 @@ extern int service_interval;
 
 int       api_init         (uev_ctx_t *ctx);
 int       api_exit         (void);
+int       api_suspend      (void);
+void      api_resume       (void);
+void      api_notify       (void);
+
+int       console_async    (uev_ctx_t *ctx);
+void      console_flush    (void);
+void      console_exit     (void);
 
 void      service_monitor  (pid_t lost, int status);
 
 const char *plugin_hook_str(hook_point_t no);
 int       plugin_exists    (hook_point_t no);
+int       plugin_pending   (hook_point_t no);
 void      plugin_run_hook  (hook_point_t no, void *arg);
 void      plugin_run_hooks (hook_point_t no);
+int       plugin_reap      (pid_t pid, int status);
 
 int       plugin_init      (uev_ctx_t *ctx);
 void      plugin_exit      (void);
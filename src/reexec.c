@@ -0,0 +1,594 @@
+/* Stateful re-exec of PID 1, hand over running services to a new Finit
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>		/* memfd_create() */
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+# include <libite/queue.h>
+#else
+# include <lite/lite.h>
+# include <lite/queue.h>
+#endif
+
+#include "finit.h"
+#include "conf.h"
+#include "helpers.h"
+#include "log.h"
+#include "logbuf.h"
+#include "private.h"
+#include "reexec.h"
+#include "schedule.h"
+#include "service.h"
+#include "sm.h"
+#include "svc.h"
+#include "util.h"
+
+/*
+ * The state is saved as text, one record per line.  Unknown keys are
+ * ignored, so an older and a newer Finit can hand over to each other.
+ *
+ *     finit 1
+ *     set runlevel 2
+ *     set api 5
+ *     wdog watchdog:finit
+ *     svc syslogd pid=123 state=7 ... len=42
+ *     <len bytes of buffered output>
+ */
+struct rec {
+	TAILQ_ENTRY(rec) link;
+
+	char         ident[MAX_IDENT_LEN];
+	pid_t        pid, oldpid;
+	int          state;
+	int          block;
+	int          starting;
+	int          started;
+	int          once;
+	int          restart_cnt;
+	unsigned int restart_tot;
+	unsigned int start_cnt;
+	unsigned int crash_cnt;
+	int          wdog_cnt;
+	long         start_time;
+	int          status;
+
+	int          fd, lfd;		/* log buffer pty master and pipe */
+	uint64_t     total;
+	size_t       len;
+	char        *data;
+};
+
+struct var {
+	char key[16];
+	int  val;
+};
+
+static TAILQ_HEAD(, rec) recs = TAILQ_HEAD_INITIALIZER(recs);
+static struct var vars[8];
+static size_t     num_vars;
+static char       wdog_ident[MAX_IDENT_LEN];
+static char     **args;
+
+extern svc_t *wdog;
+
+static void reexec_worker(void *unused);
+
+static struct wq work = {
+	.cb = reexec_worker,
+	.delay = 10
+};
+
+/*
+ * Handed over descriptors must survive execve(), everything else is
+ * closed, this also cleans up any descriptors leaked without O_CLOEXEC.
+ */
+static void keep(int fd)
+{
+	if (fd != -1)
+		fcntl(fd, F_SETFD, 0);
+}
+
+static void cloexec_all(void)
+{
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		return;
+
+	while ((d = readdir(dir))) {
+		int fd = atoi(d->d_name);
+
+		if (fd < 3 || fd == dirfd(dir))
+			continue;
+
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+
+	closedir(dir);
+}
+
+/*
+ * After an upgrade the binary we run from has been replaced, so the
+ * link reads "/sbin/finit (deleted)", the new one has the same name.
+ */
+static int exe(char *path, size_t len)
+{
+	ssize_t num;
+	char *ptr;
+
+	num = readlink("/proc/self/exe", path, len - 1);
+	if (num <= 0)
+		return -1;
+	path[num] = 0;
+
+	ptr = strstr(path, " (deleted)");
+	if (ptr && !ptr[10])
+		*ptr = 0;
+
+	return access(path, X_OK);
+}
+
+static void save_svc(FILE *fp, svc_t *svc)
+{
+	struct logbuf *lb = svc->logbuf;
+	uint64_t offset = 0;
+	int fd = -1, lfd = -1;
+	size_t len = 0;
+
+	if (lb) {
+		fd  = lb->fd;
+		lfd = lb->lfd;
+		len = min(lb->total, (uint64_t)lb->size);
+		keep(fd);
+		keep(lfd);
+	}
+
+	fprintf(fp, "svc %s pid=%d oldpid=%d state=%d block=%d starting=%d started=%d "
+		"once=%d restart_cnt=%d restart_tot=%u start_cnt=%u crash_cnt=%u "
+		"wdog_cnt=%d start_time=%ld status=%d fd=%d lfd=%d total=%llu len=%zu\n",
+		svc_ident(svc, NULL, 0), svc->pid, svc->oldpid, svc->state, svc->block,
+		svc->starting, svc->started, svc->once, svc->restart_cnt, svc->restart_tot,
+		svc->start_cnt, svc->crash_cnt, svc->wdog_cnt, svc->start_time, svc->status, fd, lfd,
+		lb ? (unsigned long long)lb->total : 0ULL, len);
+
+	while (len > 0) {
+		char buf[LOGBUF_CHUNK];
+		size_t num;
+
+		num = logbuf_read(lb, &offset, buf, min(len, sizeof(buf)));
+		if (!num)
+			break;
+
+		fwrite(buf, num, 1, fp);
+		offset += num;
+		len    -= num;
+	}
+}
+
+static int save(int fd, int sd)
+{
+	svc_t *svc, *iter = NULL;
+	FILE *fp;
+
+	fp = fdopen(dup(fd), "w");
+	if (!fp)
+		return -1;
+
+	fprintf(fp, "finit %d\n", REEXEC_VERSION);
+	fprintf(fp, "set runlevel %d\n", runlevel);
+	fprintf(fp, "set prevlevel %d\n", prevlevel);
+	fprintf(fp, "set rescue %d\n", rescue);
+	if (sd != -1) {
+		fprintf(fp, "set api %d\n", sd);
+		keep(sd);
+	}
+	if (wdog)
+		fprintf(fp, "wdog %s\n", svc_ident(wdog, NULL, 0));
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0))
+		save_svc(fp, svc);
+
+	return fclose(fp);
+}
+
+static void parse_svc(FILE *fp, char *line)
+{
+	struct rec *r;
+	char *tok;
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		_pe("Failed restoring %s", line);
+		return;
+	}
+	r->fd = r->lfd = -1;
+
+	tok = strtok(line, " ");
+	if (tok)
+		strlcpy(r->ident, tok, sizeof(r->ident));
+
+	while ((tok = strtok(NULL, " "))) {
+		char *val = strchr(tok, '=');
+		long long num;
+
+		if (!val)
+			continue;
+		*val++ = 0;
+		num = strtoll(val, NULL, 10);
+
+		if (!strcmp(tok, "pid"))
+			r->pid = num;
+		else if (!strcmp(tok, "oldpid"))
+			r->oldpid = num;
+		else if (!strcmp(tok, "state"))
+			r->state = num;
+		else if (!strcmp(tok, "block"))
+			r->block = num;
+		else if (!strcmp(tok, "starting"))
+			r->starting = num;
+		else if (!strcmp(tok, "started"))
+			r->started = num;
+		else if (!strcmp(tok, "once"))
+			r->once = num;
+		else if (!strcmp(tok, "restart_cnt"))
+			r->restart_cnt = num;
+		else if (!strcmp(tok, "restart_tot"))
+			r->restart_tot = num;
+		else if (!strcmp(tok, "start_cnt"))
+			r->start_cnt = num;
+		else if (!strcmp(tok, "crash_cnt"))
+			r->crash_cnt = num;
+		else if (!strcmp(tok, "wdog_cnt"))
+			r->wdog_cnt = num;
+		else if (!strcmp(tok, "start_time"))
+			r->start_time = num;
+		else if (!strcmp(tok, "status"))
+			r->status = num;
+		else if (!strcmp(tok, "fd"))
+			r->fd = num;
+		else if (!strcmp(tok, "lfd"))
+			r->lfd = num;
+		else if (!strcmp(tok, "total"))
+			r->total = num;
+		else if (!strcmp(tok, "len"))
+			r->len = num;
+	}
+
+	if (r->len > r->total)
+		r->len = r->total;
+	if (r->len > 0) {
+		r->data = malloc(r->len);
+		if (!r->data || fread(r->data, r->len, 1, fp) != 1) {
+			free(r->data);
+			r->data = NULL;
+			r->len  = 0;
+		}
+	}
+
+	TAILQ_INSERT_TAIL(&recs, r, link);
+}
+
+static int load(int fd)
+{
+	char line[LINE_SIZE];
+	FILE *fp;
+	int ver;
+
+	lseek(fd, 0, SEEK_SET);
+	fp = fdopen(fd, "r");
+	if (!fp) {
+		close(fd);
+		return -1;
+	}
+
+	if (!fgets(line, sizeof(line), fp) || sscanf(line, "finit %d", &ver) != 1) {
+		_e("Invalid state from previous Finit, cannot restore services.");
+		fclose(fp);
+		return -1;
+	}
+	if (ver != REEXEC_VERSION)
+		logit(LOG_NOTICE, "Restoring state version %d, we have %d.", ver, REEXEC_VERSION);
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr = chomp(line);
+
+		if (!strncmp(ptr, "svc ", 4)) {
+			parse_svc(fp, &ptr[4]);
+			continue;
+		}
+
+		if (!strncmp(ptr, "wdog ", 5)) {
+			strlcpy(wdog_ident, &ptr[5], sizeof(wdog_ident));
+			continue;
+		}
+
+		if (!strncmp(ptr, "set ", 4) && num_vars < NELEMS(vars)) {
+			struct var *v = &vars[num_vars];
+
+			if (sscanf(&ptr[4], "%15s %d", v->key, &v->val) == 2)
+				num_vars++;
+		}
+	}
+
+	return fclose(fp);
+}
+
+static struct var *var(const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < num_vars; i++) {
+		if (!strcmp(vars[i].key, key))
+			return &vars[i];
+	}
+
+	return NULL;
+}
+
+static int get(const char *key, int def)
+{
+	struct var *v = var(key);
+
+	return v ? v->val : def;
+}
+
+/**
+ * reexec_fd - Take over a descriptor from the previous Finit
+ * @key: Name of descriptor, e.g. "api"
+ *
+ * A descriptor can only be taken over once.
+ *
+ * Returns:
+ * The descriptor, or -1 if none was handed over.
+ */
+int reexec_fd(const char *key)
+{
+	struct var *v = var(key);
+
+	if (!v)
+		return -1;
+	v->key[0] = 0;
+
+	return v->val;
+}
+
+static svc_t *find(char *ident)
+{
+	char name[MAX_IDENT_LEN];
+	char *id;
+
+	strlcpy(name, ident, sizeof(name));
+	id = strchr(name, ':');
+	if (id)
+		*id++ = 0;
+
+	return svc_find_by_nameid(name, id ?: "");
+}
+
+static void restore(svc_t *svc, struct rec *r)
+{
+	char *restart_cnt = (char *)&svc->restart_cnt;
+
+	svc->pid         = r->pid;
+	svc->oldpid      = r->oldpid;
+	svc->block       = r->block;
+	svc->starting    = r->starting;
+	svc->started     = r->started;
+	svc->once        = r->once;
+	*restart_cnt     = r->restart_cnt;
+	svc->restart_tot = r->restart_tot;
+	svc->start_cnt   = r->start_cnt;
+	svc->crash_cnt   = r->crash_cnt;
+	svc->wdog_cnt    = r->wdog_cnt;
+	svc->start_time  = r->start_time;
+	svc->status      = r->status;
+
+	/* Already running with the .conf we just read */
+	svc_mark_clean(svc);
+
+	if (logbuf_size && (r->fd != -1 || r->len)) {
+		struct logbuf *lb;
+
+		lb = logbuf_new(svc->logbuf, logbuf_size);
+		if (lb) {
+			lb->total = r->total - r->len;
+			logbuf_append(lb, r->data, r->len);
+			svc->logbuf = lb;
+		}
+	}
+
+	service_resume(svc, r->state, r->fd, r->lfd);
+}
+
+/**
+ * reexec_restore - Take over services from the previous Finit
+ *
+ * Called when all .conf files have been read.  Services that have been
+ * removed from the configuration while we re-executed are stopped, the
+ * rest are resumed in the state they were in.
+ */
+void reexec_restore(void)
+{
+	struct rec *r, *tmp;
+
+	runlevel  = get("runlevel", cfglevel);
+	prevlevel = get("prevlevel", prevlevel);
+	rescue    = get("rescue", rescue);
+
+	TAILQ_FOREACH_SAFE(r, &recs, link, tmp) {
+		svc_t *svc;
+
+		TAILQ_REMOVE(&recs, r, link);
+
+		svc = find(r->ident);
+		if (svc) {
+			restore(svc, r);
+		} else {
+			if (r->pid > 1) {
+				logit(LOG_WARNING, "%s[%d] no longer in configuration, stopping it.",
+				      r->ident, r->pid);
+				if (kill(-r->pid, SIGTERM))
+					kill(r->pid, SIGTERM);
+			}
+			if (r->fd != -1)
+				close(r->fd);
+			if (r->lfd != -1)
+				close(r->lfd);
+		}
+
+		free(r->data);
+		free(r);
+	}
+
+	/* Built-in watchdogd was replaced by another watchdog daemon */
+	if (wdog_ident[0]) {
+		svc_t *svc = find(wdog_ident);
+
+		if (svc && wdog && wdog != svc && wdog->protect)
+			svc_del(wdog);
+		wdog = svc;
+	}
+
+	/* No bootstrap, go straight to the runlevel we had */
+	sm_init(&sm);
+	sm.state = SM_RUNNING_STATE;
+	bootstrap = 0;
+	enable_progress(0);
+
+	plugin_run_hooks(HOOK_RESUME);
+	service_step_all(SVC_TYPE_ANY);
+
+	/*
+	 * Children that exited while we re-executed are zombies by now,
+	 * their SIGCHLD was lost when sig_init() ignored all signals.
+	 */
+	kill(getpid(), SIGCHLD);
+
+	logit(LOG_NOTICE, "Re-executed, resuming runlevel %d.", runlevel);
+}
+
+static void reexec_worker(void *unused)
+{
+	char path[PATH_MAX];
+	char env[16];
+	int fd, sd;
+
+	if (exe(path, sizeof(path))) {
+		_pe("Cannot find Finit binary to re-execute");
+		return;
+	}
+
+	fd = memfd_create("finit-state", 0);
+	if (fd == -1) {
+		_pe("Failed saving state for re-exec");
+		return;
+	}
+
+	cloexec_all();
+	sd = api_suspend();
+	if (save(fd, sd)) {
+		_pe("Failed saving state for re-exec");
+		goto fail;
+	}
+
+	keep(fd);
+	snprintf(env, sizeof(env), "%d", fd);
+	setenv(REEXEC_ENV, env, 1);
+
+	logit(LOG_NOTICE, "Re-executing %s, services keep running.", path);
+	console_flush();
+	execv(path, args);
+
+	_pe("Failed re-executing %s", path);
+	unsetenv(REEXEC_ENV);
+fail:
+	cloexec_all();
+	api_resume();
+	close(fd);
+}
+
+/**
+ * reexec_start - Re-execute PID 1, keeping all services running
+ *
+ * The state of all services, their log buffers, and the API socket are
+ * saved to a memfd, which the new Finit restores in reexec_restore().
+ * Not allowed during bootstrap, shutdown, runlevel changes or reload.
+ *
+ * Returns:
+ * POSIX OK(0) if the re-exec has been scheduled, non-zero otherwise.
+ */
+int reexec_start(void)
+{
+	if (bootstrap || runlevel == 0 || runlevel == 6 ||
+	    sm.state != SM_RUNNING_STATE || sm.newlevel != -1 || sm.reload) {
+		logit(LOG_WARNING, "Cannot re-execute now, system is changing state.");
+		return 1;
+	}
+
+	schedule_work(&work);
+
+	return 0;
+}
+
+/**
+ * reexec_init - Check if we were re-executed by the previous Finit
+ * @argv: Arguments to PID 1, reused on re-exec
+ *
+ * Returns:
+ * Non-zero if services are to be restored with reexec_restore().
+ */
+int reexec_init(char *argv[])
+{
+	char *env;
+	int fd;
+
+	args = argv;
+
+	env = getenv(REEXEC_ENV);
+	if (!env)
+		return 0;
+
+	fd = atoi(env);
+	unsetenv(REEXEC_ENV);
+	if (fd < 3 || load(fd))
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
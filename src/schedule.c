@@ -23,6 +23,7 @@
 
 #include "config.h"
 #include "finit.h"
+#include "loop.h"
 #include "schedule.h"
 
 #define SC_INIT 0x494E4954	/* "INIT", see ascii(7) */
@@ -30,7 +31,7 @@
 /*
  * libuEv callback wrapper
  */
-static void cb(uev_t *w, void *arg, int events)
+static void work_cb(uev_t *w, void *arg, int events)
 {
 	struct wq *work = (struct wq *)arg;
 
@@ -41,6 +42,7 @@ static void cb(uev_t *w, void *arg, int events)
 
 	work->cb(work);
 }
+LOOP_PROBE(work_cb)
 
 /*
  * Place work on event queue
@@ -55,7 +57,7 @@ int schedule_work(struct wq *work)
 	msec = work->delay;
 	if (work->init != SC_INIT) {
 		work->init = SC_INIT;
-		return uev_timer_init(ctx, &work->watcher, cb, work, msec, 0);
+		return uev_timer_init(ctx, &work->watcher, LOOP_CB(work_cb), work, msec, 0);
 	}
 
 	return uev_timer_set(&work->watcher, msec, 0);
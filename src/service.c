@@ -30,6 +30,7 @@
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <termios.h>
 #include <net/if.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
@@ -43,10 +44,15 @@
 #include "cond.h"
 #include "finit.h"
 #include "helpers.h"
+#include "keepalive.h"
+#include "logbuf.h"
+#include "loop.h"
+#include "metrics.h"
 #include "pid.h"
 #include "private.h"
 #include "sig.h"
 #include "service.h"
+#include "shutdown.h"
 #include "sm.h"
 #include "tty.h"
 #include "util.h"
@@ -76,6 +82,7 @@ static void service_timeout_cb(uev_t *w, void *arg, int events)
 	if (svc->timer_cb)
 		svc->timer_cb(svc);
 }
+LOOP_PROBE(service_timeout_cb)
 
 /**
  * service_timeout_after - Call a function after some time has elapsed
@@ -95,7 +102,7 @@ static int service_timeout_after(svc_t *svc, int timeout, void (*cb)(svc_t *svc)
 		return -EBUSY;
 
 	svc->timer_cb = cb;
-	return uev_timer_init(ctx, &svc->timer, service_timeout_cb, svc, timeout, 0);
+	return uev_timer_init(ctx, &svc->timer, LOOP_CB(service_timeout_cb), svc, timeout, 0);
 }
 
 /**
@@ -172,6 +179,43 @@ static void fallback_logger(char *ident, char *prio)
 	closelog();
 }
 
+/*
+ * Called in a child process, with stdin connected to the service's
+ * output, to forward it to syslog or a log file using logit.
+ */
+static void logger(svc_t *svc)
+{
+	char *tag  = basename(svc->cmd);
+	char *prio = "daemon.info";
+
+	/* Reset signals */
+	sig_unblock();
+
+	if (!whichp(_PATH_LOGIT)) {
+		logit(LOG_INFO, _PATH_LOGIT " missing, using syslog for %s instead", svc->name);
+		fallback_logger(tag, prio);
+		_exit(0);
+	}
+
+	if (svc->log.file[0] == '/') {
+		char sz[20], num[3];
+
+		snprintf(sz, sizeof(sz), "%d", logfile_size_max);
+		snprintf(num, sizeof(num), "%d", logfile_count_max);
+
+		execlp(_PATH_LOGIT, "logit", "-f", svc->log.file, "-n", sz, "-r", num, NULL);
+		_exit(1);
+	}
+
+	if (svc->log.ident[0])
+		tag = svc->log.ident;
+	if (svc->log.prio[0])
+		prio = svc->log.prio;
+
+	execlp(_PATH_LOGIT, "logit", "-t", tag, "-p", prio, NULL);
+	_exit(1);
+}
+
 /*
  * Redirect output to syslog using the command line logit tool
  */
@@ -198,8 +242,6 @@ static int lredirect(svc_t *svc)
 	pid = fork();
 	if (pid == 0) {
 		int fds;
-		char *tag  = basename(svc->cmd);
-		char *prio = "daemon.info";
 
 		sched_yield();
 
@@ -209,47 +251,173 @@ static int lredirect(svc_t *svc)
 			_exit(0);
 		dup2(fds, STDIN_FILENO);
 
-		/* Reset signals */
-		sig_unblock();
+		logger(svc);
+	}
 
-		if (!whichp(_PATH_LOGIT)) {
-			logit(LOG_INFO, _PATH_LOGIT " missing, using syslog for %s instead", svc->name);
-			fallback_logger(tag, prio);
-			_exit(0);
-		}
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
 
-		if (svc->log.file[0] == '/') {
-			char sz[20], num[3];
+	return close(fd);
+}
 
-			snprintf(sz, sizeof(sz), "%d", logfile_size_max);
-			snprintf(num, sizeof(num), "%d", logfile_count_max);
+/*
+ * The log buffer is opt-in with log:buffer, output then passes through
+ * PID 1, which a busy PID 1 would stall.  run commands are waited for
+ * by PID 1 in complete(), so we would not be able to drain their output,
+ * they always use lredirect().
+ */
+static int has_logbuf(svc_t *svc)
+{
+	if (!logbuf_size || svc_is_tty(svc) || svc->type == SVC_TYPE_RUN)
+		return 0;
+
+	return svc->log.enabled && svc->log.buffer && !svc->log.null && !svc->log.console;
+}
+
+/*
+ * Read service output from the pty, save the tail in the log buffer,
+ * and pass it on to logit.  If logit cannot keep up we drop output
+ * rather than blocking PID 1, the log buffer still has it.  Dropped
+ * bytes are counted and reported when logit has caught up again.
+ */
+static void logbuf_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc = (svc_t *)arg;
+	struct logbuf *lb = svc->logbuf;
+	char buf[LOGBUF_CHUNK];
+	ssize_t len, num;
 
-			execlp(_PATH_LOGIT, "logit", "-f", svc->log.file, "-n", sz, "-r", num, NULL);
-			_exit(1);
+	if (UEV_ERROR == events) {
+		logbuf_close(lb);
+		return;
+	}
+
+	len = read(w->fd, buf, sizeof(buf));
+	if (len <= 0) {
+		if (len == -1 && (errno == EAGAIN || errno == EINTR))
+			return;
+
+		/* EOF, or EIO when the last slave fd is closed */
+		logbuf_close(lb);
+		return;
+	}
+
+	logbuf_append(lb, buf, len);
+	if (lb->lfd == -1)
+		return;
+
+	num = write(lb->lfd, buf, len);
+	if (num == -1) {
+		if (errno != EAGAIN) {
+			close(lb->lfd);
+			lb->lfd = -1;
+			return;
 		}
+		num = 0;
+	}
 
-		if (svc->log.ident[0])
-			tag = svc->log.ident;
-		if (svc->log.prio[0])
-			prio = svc->log.prio;
+	if (num < len) {
+		if (!lb->lost)
+			logit(LOG_WARNING, "%s: logger cannot keep up, dropping output.", svc_ident(svc, NULL, 0));
+		lb->lost    += len - num;
+		lb->dropped += len - num;
+	} else if (lb->lost) {
+		logit(LOG_WARNING, "%s: %llu bytes of output dropped, not logged.",
+		      svc_ident(svc, NULL, 0), (unsigned long long)lb->lost);
+		lb->lost = 0;
+	}
+}
+LOOP_PROBE(logbuf_cb)
 
-		execlp(_PATH_LOGIT, "logit", "-t", tag, "-p", prio, NULL);
-		_exit(1);
+/*
+ * Called by PID 1 before forking the service.  Like lredirect(), the
+ * service gets a pty, but the master end is read by us.  The slave is
+ * opened here, so the master does not signal hangup before the service
+ * has had a chance to open it.
+ *
+ * Returns:
+ * The pty slave, to be used for stdout/stderr by the service, or -1.
+ */
+static int logbuf_open(svc_t *svc)
+{
+	struct logbuf *lb;
+	struct termios tio;
+	int fd, sd, pfd[2];
+	pid_t pid;
+
+	/* Stop any previous watcher before the buffer may move */
+	logbuf_close(svc->logbuf);
+	lb = logbuf_new(svc->logbuf, logbuf_size);
+	if (!lb)
+		return -1;
+	svc->logbuf = lb;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (grantpt(fd) == -1 || unlockpt(fd) == -1)
+		goto err;
+
+	sd = open(ptsname(fd), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (sd == -1)
+		goto err;
+
+	/* No \r\n translation, keep the log buffer clean */
+	if (!tcgetattr(sd, &tio)) {
+		cfmakeraw(&tio);
+		tcsetattr(sd, TCSANOW, &tio);
 	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
-	dup2(fd, STDOUT_FILENO);
-	dup2(fd, STDERR_FILENO);
+	if (pipe2(pfd, O_CLOEXEC))
+		goto err_sd;
 
-	return close(fd);
+	pid = fork();
+	if (pid == 0) {
+		setsid();
+		dup2(pfd[0], STDIN_FILENO);
+		close(pfd[1]);
+		close(sd);
+		close(fd);
+		logger(svc);
+	}
+	close(pfd[0]);
+	if (pid == -1) {
+		close(pfd[1]);
+		goto err_sd;
+	}
+
+	fcntl(pfd[1], F_SETFL, fcntl(pfd[1], F_GETFL) | O_NONBLOCK);
+	lb->lfd = pfd[1];
+	lb->fd  = fd;
+	if (uev_io_init(ctx, &lb->watcher, LOOP_CB(logbuf_cb), svc, fd, UEV_READ)) {
+		lb->fd = -1;
+		logbuf_close(lb);
+		goto err_sd;
+	}
+
+	return sd;
+err_sd:
+	close(sd);
+err:
+	close(fd);
+	return -1;
 }
 
 /*
- * Handle redirection of process output, if enabled
+ * Handle redirection of process output, if enabled.  With log buffer,
+ * @out is the pty slave from logbuf_open(), otherwise -1.
  */
-static int redirect(svc_t *svc)
+static int redirect(svc_t *svc, int out)
 {
 	stdin_redirect();
 
+	if (out != -1) {
+		dup2(out, STDOUT_FILENO);
+		dup2(out, STDERR_FILENO);
+		return close(out);
+	}
+
 	if (svc->log.enabled) {
 		if (svc->log.null)
 			return fredirect("/dev/null");
@@ -447,6 +615,7 @@ static int service_start(svc_t *svc)
 	int result = 0, do_progress = 1;
 	sigset_t nmask, omask;
 	char grnam[80];
+	int out = -1;
 	pid_t pid;
 	size_t i;
 
@@ -508,6 +677,9 @@ static int service_start(svc_t *svc)
 	sigaddset(&nmask, SIGCHLD);
 	sigprocmask(SIG_BLOCK, &nmask, &omask);
 
+	if (has_logbuf(svc))
+		out = logbuf_open(svc);
+
 	pid = service_fork(svc);
 	if (pid == 0) {
 		char *args[MAX_NUM_SVC_ARGS + 1];
@@ -591,7 +763,8 @@ static int service_start(svc_t *svc)
 			logit(LOG_ERR, "failed setsid(), pid %d: %s", pid, strerror(errno));
 
 		if (!svc_is_tty(svc))
-			redirect(svc);
+			redirect(svc, out);
+		keepalive_env(svc);
 		sig_unblock();
 
 		if (svc_is_runtask(svc))
@@ -615,6 +788,9 @@ static int service_start(svc_t *svc)
 		_d("Starting %s %s", svc->cmd, buf);
 	}
 
+	if (out != -1)
+		close(out);
+
 	if (svc_is_tty(svc))
 		cgroup_user("getty", pid);
 	else
@@ -624,6 +800,7 @@ static int service_start(svc_t *svc)
 
 	svc->pid = pid;
 	svc->start_time = jiffies();
+	svc->start_cnt++;
 
 	switch (svc->type) {
 	case SVC_TYPE_RUN:
@@ -639,6 +816,7 @@ static int service_start(svc_t *svc)
 
 	case SVC_TYPE_SERVICE:
 		pid_file_create(svc);
+		keepalive_start(svc);
 		break;
 
 	default:
@@ -688,8 +866,9 @@ static void service_cleanup(svc_t *svc)
 {
 	char *fn;
 
-	/* PID collected, cancel any pending SIGKILL */
+	/* PID collected, cancel any pending SIGKILL and watchdog */
 	service_timeout_cancel(svc);
+	keepalive_stop(svc);
 
 	fn = pid_file(svc);
 	if (fn && remove(fn) && errno != ENOENT)
@@ -769,7 +948,7 @@ static int service_stop(svc_t *svc)
 		switch (pid) {
 		case 0:
 			setsid();
-			redirect(svc);
+			redirect(svc, -1);
 			exec_runtask(svc->cmd, args);
 			_exit(0);
 			break;
@@ -778,6 +957,10 @@ static int service_stop(svc_t *svc)
 			rc = 1;
 			break;
 		default:
+			/* At shutdown all stop scripts run in parallel */
+			if (shutdown_script(svc, pid))
+				break;
+
 			rc = WEXITSTATUS(complete(svc->cmd, pid));
 			break;
 		}
@@ -885,7 +1068,7 @@ void service_runlevel(int newlevel)
 }
 
 /*
- * log:/path/to/logfile,priority:facility.level,tag:ident
+ * log:/path/to/logfile,priority:facility.level,tag:ident,buffer
  */
 static void parse_log(svc_t *svc, char *arg)
 {
@@ -899,6 +1082,8 @@ static void parse_log(svc_t *svc, char *arg)
 			svc->log.null = 1;
 		else if (!strcmp(tok, "console") || !strcmp(tok, "/dev/console"))
 			svc->log.console = 1;
+		else if (!strcmp(tok, "buffer"))
+			svc->log.buffer = 1;
 		else if (tok[0] == '/')
 			strlcpy(svc->log.file, tok, sizeof(svc->log.file));
 		else if (!strcmp(tok, "priority") || !strcmp(tok, "prio"))
@@ -973,6 +1158,47 @@ static void parse_killdelay(svc_t *svc, char *delay)
 	svc->killdelay = (int)(sec * 1000);
 }
 
+static void parse_watchdog(svc_t *svc, char *arg)
+{
+	const char *errstr;
+	long long sec;
+
+	svc->wdog = 0;
+	if (!arg)
+		return;
+
+	if (!svc_is_daemon(svc)) {
+		_e("%s: watchdog is only supported for services", svc->cmd);
+		return;
+	}
+
+	sec = strtonum(arg, 1, 3600, &errstr);
+	if (errstr) {
+		_e("%s: watchdog %s is %s (1-3600)", svc->cmd, arg, errstr);
+		return;
+	}
+
+	svc->wdog = (int)sec;
+}
+
+static void parse_settle(svc_t *svc, char *arg)
+{
+	const char *errstr;
+	long long msec;
+
+	svc->settle = 0;
+	if (!arg)
+		return;
+
+	msec = strtonum(arg, 0, 60000, &errstr);
+	if (errstr) {
+		_e("%s: settle %s is %s (0-60000)", svc->cmd, arg, errstr);
+		return;
+	}
+
+	svc->settle = (int)msec;
+}
+
 static void parse_script(char *type, char *script, char *buf, size_t len)
 {
 	if (access(script, X_OK))
@@ -1141,6 +1367,7 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	char *cmd, *desc, *runlevels = NULL, *cond = NULL;
 	char *username = NULL, *log = NULL, *pid = NULL;
 	char *name = NULL, *halt = NULL, *delay = NULL;
+	char *settle = NULL, *wdog = NULL;
 	char *id = NULL, *env = NULL, *cgroup = NULL;
 	char *pre_script = NULL, *post_script = NULL;
 	struct tty tty = { 0 };
@@ -1226,6 +1453,10 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			halt = &cmd[5];
 		else if (!strncasecmp(cmd, "kill:", 5))
 			delay = &cmd[5];
+		else if (!strncasecmp(cmd, "settle:", 7))
+			settle = &cmd[7];
+		else if (!strncasecmp(cmd, "watchdog:", 9))
+			wdog = &cmd[9];
 		else if (!strncasecmp(cmd, "pre:", 4))
 			pre_script = &cmd[4];
 		else if (!strncasecmp(cmd, "post:", 5))
@@ -1384,6 +1615,8 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 		parse_sighalt(svc, halt);
 	if (delay)
 		parse_killdelay(svc, delay);
+	parse_settle(svc, settle);
+	parse_watchdog(svc, wdog);
 	if (pre_script)
 		parse_script("pre", pre_script, svc->pre_script, sizeof(svc->pre_script));
 	if (post_script)
@@ -1445,6 +1678,7 @@ void service_unregister(svc_t *svc)
 		return;
 
 	service_stop(svc);
+	keepalive_stop(svc);
 	svc_del(svc);
 }
 
@@ -1457,6 +1691,15 @@ void service_monitor(pid_t lost, int status)
 
 	svc = svc_find_by_pid(lost);
 	if (!svc) {
+		if (shutdown_reap(lost)) {
+			_d("collected stop script %d", lost);
+			sm_step(&sm);
+			return;
+		}
+
+		if (plugin_reap(lost, status))
+			return;
+
 		_d("collected unknown PID %d", lost);
 		return;
 	}
@@ -1696,7 +1939,9 @@ static void svc_set_state(svc_t *svc, svc_state_t new)
 {
 	svc_state_t *state = (svc_state_t *)&svc->state;
 
+	metrics_svc_state(svc, new);
 	*state = new;
+	api_notify();
 
 	/* if PID isn't collected within SVC_TERM_TIMEOUT msec, kill it! */
 	if (*state == SVC_STOPPING_STATE) {
@@ -1722,6 +1967,181 @@ static void svc_set_state(svc_t *svc, svc_state_t new)
 	}
 }
 
+/**
+ * service_resume - Resume a service handed over by the previous Finit
+ * @svc:   Service, with PID and counters restored by reexec_restore()
+ * @state: State the service was in
+ * @fd:    Log buffer pty master, or -1
+ * @lfd:   Pipe to the service's logit, or -1
+ *
+ * Re-attaches the log buffer and re-arms any pending kill or retry
+ * timer, or the software watchdog, from the start, the time already
+ * passed is not saved.
+ */
+void service_resume(svc_t *svc, svc_state_t state, int fd, int lfd)
+{
+	struct logbuf *lb = svc->logbuf;
+
+	if (lb && fd != -1) {
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		if (lfd != -1)
+			fcntl(lfd, F_SETFD, FD_CLOEXEC);
+
+		lb->fd  = fd;
+		lb->lfd = lfd;
+		if (uev_io_init(ctx, &lb->watcher, LOOP_CB(logbuf_cb), svc, fd, UEV_READ)) {
+			lb->fd = -1;
+			logbuf_close(lb);
+			close(fd);
+		}
+	} else {
+		if (fd != -1)
+			close(fd);
+		if (lfd != -1)
+			close(lfd);
+	}
+
+	/* Arms the SIGKILL timer for STOPPING */
+	svc_set_state(svc, state);
+
+	switch (state) {
+	case SVC_SETUP_STATE:
+	case SVC_CLEANUP_STATE:
+		if (svc->pid > 1)
+			service_timeout_after(svc, svc->killdelay, service_kill_script);
+		break;
+
+	case SVC_HALTED_STATE:
+		if (svc->block == SVC_BLOCK_RESTARTING)
+			service_timeout_after(svc, 1, service_retry);
+		break;
+
+	case SVC_RUNNING_STATE:
+		if (svc_is_daemon(svc) && svc->pid > 1)
+			keepalive_start(svc);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int conflict(svc_t *svc, svc_t *stop)
+{
+	char grp[MAX_ARG_LEN], stop_grp[MAX_ARG_LEN];
+	char cond[MAX_COND_LEN], *tok, *ptr;
+	char *a, *b;
+
+	/* Depends on, or is depended on by, the stopping service */
+	if (cond_affects(mkcond(stop, cond, sizeof(cond)), svc->cond))
+		return 1;
+	if (cond_affects(mkcond(svc, cond, sizeof(cond)), stop->cond))
+		return 1;
+
+	/* Shared condition */
+	strlcpy(cond, svc->cond, sizeof(cond));
+	for (tok = strtok_r(cond, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr)) {
+		if (cond_affects(tok, stop->cond))
+			return 1;
+	}
+
+	/* Same PID file, skip any leading '!' */
+	a = svc->pidfile[0] == '!' ? &svc->pidfile[1] : svc->pidfile;
+	b = stop->pidfile[0] == '!' ? &stop->pidfile[1] : stop->pidfile;
+	if (a[0] && !strcmp(a, b))
+		return 1;
+
+	/* Same TTY */
+	if (svc_is_tty(svc) && svc_is_tty(stop) && !strcmp(svc->dev, stop->dev))
+		return 1;
+
+	/* Same cgroup leaf */
+	if (!strcmp(svc->cgroup.name, stop->cgroup.name) &&
+	    !strcmp(group_name(svc, grp, sizeof(grp)), group_name(stop, stop_grp, sizeof(stop_grp))))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * During reload, services may be started while others are still
+ * stopping, unless they share a condition, PID file, TTY, or cgroup
+ * with any of them.  Services not yet stepped, which are about to be
+ * stopped or restarted, count as stopping.  At runlevel change nothing
+ * is started until all have stopped and HOOK_RUNLEVEL_CHANGE has run,
+ * plugins rely on reconfiguring the system there.
+ *
+ * Returns: %NULL if @svc can start now, or the service it waits for.
+ */
+static svc_t *service_blocked(svc_t *svc)
+{
+	svc_t *stop, *iter = NULL;
+
+	if (!sm_is_in_teardown(&sm))
+		return NULL;
+
+	if (!sm_is_in_reload(&sm))
+		return svc;
+
+	for (stop = svc_iterator(&iter, 1); stop; stop = svc_iterator(&iter, 0)) {
+		if (stop == svc || stop->pid <= 1)
+			continue;
+
+		/* Stopping, or about to be stopped or restarted */
+		if (stop->state != SVC_STOPPING_STATE && svc_enabled(stop) && !svc_is_changed(stop))
+			continue;
+
+		if (conflict(svc, stop))
+			return stop;
+	}
+
+	return NULL;
+}
+
+/*
+ * Aggregate condition state of @svc with the service's own settle time
+ * applied on top of any per-condition settle time.  A change must hold
+ * for svc->settle msec before we act on it, meanwhile the last state
+ * acted on is returned.  The first state seen is acted on at once, the
+ * settle time is for flapping, not for delaying boot.  Flux is passed
+ * through, it is used by reload.
+ */
+static cond_state_t service_cond(svc_t *svc)
+{
+	cond_state_t cond;
+	uint64_t now, usec;
+
+	cond = cond_get_agg_settled(svc->cond);
+	/* After flux, i.e. reload, the state is seen as if for the first time */
+	if (!svc->settle || cond == COND_FLUX) {
+		svc->cond_raw = svc->cond_last = cond == COND_FLUX ? -1 : (int)cond;
+		return cond;
+	}
+
+	now = mono_usec();
+	if (svc->cond_last == -1) {
+		svc->cond_raw = svc->cond_last = cond;
+		svc->cond_ts  = now;
+		return cond;
+	}
+
+	if ((int)cond != svc->cond_raw) {
+		svc->cond_raw = cond;
+		svc->cond_ts  = now;
+	}
+
+	if ((int)cond != svc->cond_last) {
+		usec = (uint64_t)svc->settle * 1000;
+		if (now - svc->cond_ts < usec) {
+			cond_settle_arm(svc->cond_ts + usec);
+			return svc->cond_last;
+		}
+		svc->cond_last = cond;
+	}
+
+	return cond;
+}
+
 /*
  * Transition task/run/service
  *
@@ -1804,9 +2224,9 @@ restart:
 	case SVC_READY_STATE:
 		if (!enabled) {
 			svc_set_state(svc, SVC_HALTED_STATE);
-		} else if (cond_get_agg(svc->cond) == COND_ON) {
-			/* wait until all processes have been stopped before continuing... */
-			if (sm_is_in_teardown(&sm))
+		} else if (service_cond(svc) == COND_ON) {
+			/* wait for conflicting processes to be stopped before continuing... */
+			if (service_blocked(svc))
 				break;
 
 			err = service_start(svc);
@@ -1827,12 +2247,15 @@ restart:
 
 	case SVC_RUNNING_STATE:
 		if (!enabled) {
-			service_stop(svc);
+			/* At shutdown, wait for services depending on us */
+			if (!shutdown_held(svc))
+				service_stop(svc);
 			break;
 		}
 
 		if (!svc->pid) {
 			if (svc_is_daemon(svc) || svc_is_tty(svc)) {
+				svc->crash_cnt++;
 				svc_restarting(svc);
 				svc_set_state(svc, SVC_HALTED_STATE);
 
@@ -1857,7 +2280,7 @@ restart:
 			}
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = service_cond(svc);
 		switch (cond) {
 		case COND_OFF:
 			service_stop(svc);
@@ -1874,10 +2297,10 @@ restart:
 					service_stop(svc);
 				else {
 					/*
-					 * wait until all processes have been
+					 * wait for conflicting processes to be
 					 * stopped before continuing...
 					 */
-					if (sm_is_in_teardown(&sm))
+					if (service_blocked(svc))
 						break;
 					service_restart(svc);
 				}
@@ -1890,6 +2313,9 @@ restart:
 
 	case SVC_WAITING_STATE:
 		if (!enabled) {
+			if (shutdown_held(svc))
+				break;
+
 			kill(svc->pid, SIGCONT);
 			service_stop(svc);
 			break;
@@ -1897,11 +2323,12 @@ restart:
 
 		if (!svc->pid) {
 			(*restart_cnt)++;
+			svc->crash_cnt++;
 			svc_set_state(svc, SVC_READY_STATE);
 			break;
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = service_cond(svc);
 		switch (cond) {
 		case COND_ON:
 			kill(svc->pid, SIGCONT);
@@ -2056,6 +2483,7 @@ static void service_interval_cb(uev_t *w, void *arg, int events)
 
 	service_init();
 }
+LOOP_PROBE(service_interval_cb)
 
 /*
  * The service_interval may change (conf) between invocations, so we
@@ -2067,7 +2495,7 @@ void service_init(void)
 	static uev_t watcher;
 
 	if (!initialized) {
-		uev_timer_init(ctx, &watcher, service_interval_cb, NULL, service_interval, 0);
+		uev_timer_init(ctx, &watcher, LOOP_CB(service_interval_cb), NULL, service_interval, 0);
 		initialized = 1;
 	} else
 		uev_timer_set(&watcher, service_interval, 0);
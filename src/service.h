@@ -38,6 +38,7 @@ void      service_update_rdeps   (void);
 int       service_step           (svc_t *svc);
 void      service_step_all       (int types);
 void      service_worker         (void *unused);
+void      service_resume         (svc_t *svc, svc_state_t state, int fd, int lfd);
 
 int       service_completed      (void);
 
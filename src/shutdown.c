@@ -0,0 +1,340 @@
+/* Dependency ordered, parallel, stop of all services at shutdown
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <string.h>
+#ifdef _LIBITE_LITE
+# include <libite/lite.h>
+# include <libite/queue.h>
+#else
+# include <lite/lite.h>
+# include <lite/queue.h>
+#endif
+#include <uev/uev.h>
+
+#include "finit.h"
+#include "cond.h"
+#include "log.h"
+#include "loop.h"
+#include "service.h"
+#include "shutdown.h"
+#include "svc.h"
+#include "util.h"
+
+#define SLOWEST_MAX 3		/* Services to report */
+
+/*
+ * Services are stopped in levels.  Services no other service depends
+ * on, i.e. nobody has their <pid/NAME> in their condition, are at level
+ * 0 and are stopped first, all in parallel.  Then level 1, services
+ * only level 0 services depend on, and so on.  A service is held back,
+ * RUNNING, until its level is reached.  When the deadline is reached
+ * all remaining services are killed.
+ */
+struct script {
+	TAILQ_ENTRY(script) link;
+
+	pid_t    pid;
+	uint64_t start;
+	char     ident[MAX_IDENT_LEN];
+};
+
+struct slow {
+	char     ident[MAX_IDENT_LEN];
+	uint64_t usec;
+};
+
+int shutdown_timeout = SHUTDOWN_TIMEOUT * 1000;
+
+static TAILQ_HEAD(, script) scripts = TAILQ_HEAD_INITIALIZER(scripts);
+static struct slow slowest[SLOWEST_MAX];
+
+static uev_t    deadline;
+static int      armed;
+static int      active;
+static int      level, max_level;
+static uint64_t start;
+
+static double seconds(uint64_t usec)
+{
+	return (double)usec / 1000000.0;
+}
+
+/* Time spent stopping since shutdown began */
+static uint64_t stopping(svc_t *svc)
+{
+	uint64_t usec;
+
+	usec = svc->state_usec[SVC_STOPPING_STATE] - svc->stop_usec;
+	if (svc->state == SVC_STOPPING_STATE && svc->state_ts)
+		usec += mono_usec() - svc->state_ts;
+
+	return usec;
+}
+
+static void account(const char *ident, uint64_t usec)
+{
+	int i, j;
+
+	for (i = 0; i < SLOWEST_MAX; i++) {
+		if (usec <= slowest[i].usec)
+			continue;
+
+		for (j = SLOWEST_MAX - 1; j > i; j--)
+			slowest[j] = slowest[j - 1];
+
+		strlcpy(slowest[i].ident, ident, sizeof(slowest[i].ident));
+		slowest[i].usec = usec;
+		break;
+	}
+}
+
+/*
+ * Iterate until no level changes, a dependency cycle would go on for
+ * ever, so we stop after as many rounds as there are services.
+ */
+static void levels(void)
+{
+	svc_t *svc, *dep, *iter = NULL, *iter2 = NULL;
+	int changed, rounds = 0, num = 0;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		svc->stop_level = 0;
+		svc->stop_usec  = svc->state_usec[SVC_STOPPING_STATE];
+		num++;
+	}
+
+	do {
+		changed = 0;
+		for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+			char cond[MAX_COND_LEN];
+
+			mkcond(svc, cond, sizeof(cond));
+			for (dep = svc_iterator(&iter2, 1); dep; dep = svc_iterator(&iter2, 0)) {
+				if (dep == svc || !svc_has_cond(dep))
+					continue;
+
+				if (!cond_affects(cond, dep->cond))
+					continue;
+
+				if (svc->stop_level <= dep->stop_level) {
+					svc->stop_level = dep->stop_level + 1;
+					changed = 1;
+				}
+			}
+		}
+	} while (changed && ++rounds < num);
+
+	max_level = 0;
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->stop_level > max_level)
+			max_level = svc->stop_level;
+	}
+}
+
+/*
+ * Release all held services and kill everything still running, both
+ * services and SysV stop scripts, and tell the user who is to blame.
+ */
+static void deadline_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc, *iter = NULL;
+	struct script *s;
+
+	armed = 0;
+	logit(LOG_CONSOLE | LOG_WARNING, "Shutdown deadline, %d sec, reached, killing remaining services:",
+	      shutdown_timeout / 1000);
+
+	level = max_level;
+	service_step_all(SVC_TYPE_ANY);
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->state != SVC_STOPPING_STATE || svc->pid <= 1)
+			continue;
+
+		logit(LOG_CONSOLE | LOG_WARNING, "  %s[%d], stopping for %.1f sec",
+		      svc_ident(svc, NULL, 0), svc->pid, seconds(stopping(svc)));
+		if (kill(-svc->pid, SIGKILL))
+			kill(svc->pid, SIGKILL);
+	}
+
+	TAILQ_FOREACH(s, &scripts, link) {
+		logit(LOG_CONSOLE | LOG_WARNING, "  %s stop script[%d], running for %.1f sec",
+		      s->ident, s->pid, seconds(mono_usec() - s->start));
+		kill(-s->pid, SIGKILL);
+	}
+}
+LOOP_PROBE(deadline_cb)
+
+/**
+ * shutdown_begin - Start stopping services for halt or reboot
+ *
+ * Called when entering runlevel 0 or 6, before stepping the services.
+ */
+void shutdown_begin(void)
+{
+	levels();
+	level  = 0;
+	active = 1;
+	start  = mono_usec();
+	memset(slowest, 0, sizeof(slowest));
+
+	_d("Stopping services in %d levels, deadline %d msec", max_level + 1, shutdown_timeout);
+	if (shutdown_timeout > 0 &&
+	    !uev_timer_init(ctx, &deadline, LOOP_CB(deadline_cb), NULL, shutdown_timeout, 0))
+		armed = 1;
+}
+
+/**
+ * shutdown_end - All services have been stopped
+ *
+ * Logs the time it took, and the services that took the longest.
+ */
+void shutdown_end(void)
+{
+	svc_t *svc, *iter = NULL;
+	uint64_t total;
+	int i;
+
+	if (!active)
+		return;
+
+	active = 0;
+	if (armed) {
+		uev_timer_stop(&deadline);
+		armed = 0;
+	}
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0))
+		account(svc_ident(svc, NULL, 0), stopping(svc));
+
+	total = mono_usec() - start;
+	logit(LOG_NOTICE, "All services stopped in %.1f sec", seconds(total));
+	if (total < 1000000)
+		return;
+
+	for (i = 0; i < SLOWEST_MAX && slowest[i].usec >= 100000; i++)
+		logit(LOG_NOTICE, "  %s took %.1f sec", slowest[i].ident, seconds(slowest[i].usec));
+}
+
+/**
+ * shutdown_held - Should stopping this service wait?
+ * @svc: Service not allowed in the new runlevel
+ *
+ * Returns:
+ * %TRUE(1) while services depending on @svc are still being stopped.
+ */
+int shutdown_held(svc_t *svc)
+{
+	return active && svc->stop_level > level;
+}
+
+/**
+ * shutdown_next - Move on to stop the next level of services
+ *
+ * Called when all stopped services have been collected.
+ *
+ * Returns:
+ * %TRUE(1) if the services should be stepped again, %FALSE(0) if there
+ * are no more levels, or we are waiting for SysV stop scripts.
+ */
+int shutdown_next(void)
+{
+	if (!active || level >= max_level || !TAILQ_EMPTY(&scripts))
+		return 0;
+
+	level++;
+	_d("Stopping services at level %d ...", level);
+
+	return 1;
+}
+
+/**
+ * shutdown_busy - Are SysV stop scripts still running?
+ */
+int shutdown_busy(void)
+{
+	return !TAILQ_EMPTY(&scripts);
+}
+
+/**
+ * shutdown_script - Track a SysV stop script at shutdown
+ * @svc: SysV service being stopped
+ * @pid: PID of '@svc->cmd stop'
+ *
+ * At shutdown stop scripts are not waited for one by one, they run in
+ * parallel and are collected by the SIGCHLD handler.
+ *
+ * Returns:
+ * %TRUE(1) if @pid is tracked, %FALSE(0) if the caller should wait.
+ */
+int shutdown_script(svc_t *svc, pid_t pid)
+{
+	struct script *s;
+
+	if (!active)
+		return 0;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return 0;
+
+	s->pid   = pid;
+	s->start = mono_usec();
+	svc_ident(svc, s->ident, sizeof(s->ident));
+	TAILQ_INSERT_TAIL(&scripts, s, link);
+
+	return 1;
+}
+
+/**
+ * shutdown_reap - Collect a SysV stop script
+ * @pid: PID not belonging to any service
+ *
+ * Returns:
+ * %TRUE(1) if @pid was a stop script, %FALSE(0) otherwise.
+ */
+int shutdown_reap(pid_t pid)
+{
+	struct script *s, *tmp;
+
+	TAILQ_FOREACH_SAFE(s, &scripts, link, tmp) {
+		if (s->pid != pid)
+			continue;
+
+		account(s->ident, mono_usec() - s->start);
+		TAILQ_REMOVE(&scripts, s, link);
+		free(s);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
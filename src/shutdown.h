@@ -0,0 +1,52 @@
+/* Dependency ordered, parallel, stop of all services at shutdown
+ *
+ * Copyright (c) 2008-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_SHUTDOWN_H_
+#define FINIT_SHUTDOWN_H_
+
+#include <sys/types.h>
+
+#include "svc.h"
+
+#define SHUTDOWN_TIMEOUT  0	/* sec, default no deadline, services get kill:SEC */
+
+extern int shutdown_timeout;	/* msec, 0: no deadline */
+
+void shutdown_begin  (void);
+void shutdown_end    (void);
+
+int  shutdown_held   (svc_t *svc);
+int  shutdown_next   (void);
+int  shutdown_busy   (void);
+
+int  shutdown_script (svc_t *svc, pid_t pid);
+int  shutdown_reap   (pid_t pid);
+
+#endif /* FINIT_SHUTDOWN_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -85,6 +85,8 @@
 #include "conf.h"
 #include "config.h"
 #include "helpers.h"
+#include "loop.h"
+#include "metrics.h"
 #include "plugin.h"
 #include "private.h"
 #include "sig.h"
@@ -165,6 +167,8 @@ static struct sigmap {
 void mdadm_wait(void);
 void unmount_tmpfs(void);
 void unmount_regular(void);
+void swapoff_all(void);
+void remount_ro(void);
 
 /*
  * Kernel threads have no cmdline so fgets() returns NULL for them.  We
@@ -232,11 +236,14 @@ static int status_callback(int pid, int *context)
 /* return value:
  *  1 - at least one process remaining
  *  0 - no processes remaining
+ *
+ * Polls often, most processes exit right away on SIGTERM, there is
+ * no need to hold up the reboot for the full timeout.
  */
 static int do_wait(int secs)
 {
 	int has_proc;
-	int tmo = 250000;
+	int tmo = 50000;
 	int iterations = secs*1000*1000/tmo;
 
 	do {
@@ -262,6 +269,9 @@ void do_shutdown(shutop_t op)
 	 */
 	sched_setscheduler(1, SCHED_RR, &sched_param);
 
+	/* Event loop no longer runs, back to synchronous console output */
+	console_exit();
+
 	if (sdown)
 		run_interactive(sdown, "Calling shutdown hook: %s", sdown);
 
@@ -305,16 +315,13 @@ void do_shutdown(shutop_t op)
 
 	/* Unmount any tmpfs before unmounting swap ... */
 	unmount_tmpfs();
-	run("swapoff -e -a");
+	swapoff_all();
 
 	/* ... unmount remaining regular file systems. */
 	unmount_regular();
 
-	/* We sit on / so we must remount it ro, try all the things! */
-	sync();
-	run("mount -n -o remount,ro -t dummytype dummydev /");
-	run("mount -n -o remount,ro dummydev /");
-	run("mount -n -o remount,ro /");
+	/* We sit on / so we must remount it ro, after syncing everything */
+	remount_ro();
 
 	/* Call mdadm to mark any RAID array(s) as clean before halting. */
 	mdadm_wait();
@@ -360,6 +367,7 @@ static void sighup_cb(uev_t *w, void *arg, int events)
 	/* INIT_CMD_RELOAD: 'init q', 'initctl reload', and SIGHUP */
 	service_reload_dynamic();
 }
+LOOP_PROBE(sighup_cb)
 
 /*
  * SIGINT: generates <sys/key/ctrlaltdel> condition, which the sys.so
@@ -376,6 +384,7 @@ static void sigint_cb(uev_t *w, void *arg, int events)
 
 	cond_set_oneshot_noupdate("sys/key/ctrlaltdel");
 }
+LOOP_PROBE(sigint_cb)
 
 /*
  * SIGPWR: generates <sys/pwr/fail> condition, which the sys.so plugin
@@ -392,6 +401,7 @@ static void sigpwr_cb(uev_t *w, void *arg, int events)
 
 	cond_set_oneshot_noupdate("sys/pwr/fail");
 }
+LOOP_PROBE(sigpwr_cb)
 
 /*
  * SIGUSR1: SysV init/systemd API socket restart
@@ -408,6 +418,7 @@ static void sigusr1_cb(uev_t *w, void *arg, int events)
 	api_exit();
 	api_init(w->ctx);
 }
+LOOP_PROBE(sigusr1_cb)
 
 /*
  * SIGUSR2: BusyBox style poweroff
@@ -423,6 +434,7 @@ static void sigusr2_cb(uev_t *w, void *arg, int events)
 	halt = SHUT_OFF;
 	service_runlevel(0);
 }
+LOOP_PROBE(sigusr2_cb)
 
 /*
  * SIGTERM: BusyBox style reboot
@@ -438,6 +450,7 @@ static void sigterm_cb(uev_t *w, void *arg, int events)
 	halt = SHUT_REBOOT;
 	service_runlevel(6);
 }
+LOOP_PROBE(sigterm_cb)
 
 /*
  * SIGCHLD: one of our children has died
@@ -462,9 +475,11 @@ static void sigchld_cb(uev_t *w, void *arg, int events)
 		}
 
 		_d("Collected child %d", pid);
+		metrics.reaps++;
 		service_monitor(pid, status);
 	}
 }
+LOOP_PROBE(sigchld_cb)
 
 /*
  * Convert SIGFOO to a number, if it exists
@@ -558,22 +573,22 @@ void sig_setup(uev_ctx_t *ctx)
 	 * We need to disable kernel default so it sends us SIGINT
 	 */
 	reboot(RB_DISABLE_CAD);
-	uev_signal_init(ctx, &sigint_watcher, sigint_cb, NULL, SIGINT);
+	uev_signal_init(ctx, &sigint_watcher,  LOOP_CB(sigint_cb),  NULL, SIGINT);
 
 	/* BusyBox/SysV init style signals for halt, power-off and reboot. */
-	uev_signal_init(ctx, &sigusr1_watcher, sigusr1_cb, NULL, SIGUSR1);
-	uev_signal_init(ctx, &sigusr2_watcher, sigusr2_cb, NULL, SIGUSR2);
-	uev_signal_init(ctx, &sigpwr_watcher,  sigpwr_cb,  NULL, SIGPWR);
-	uev_signal_init(ctx, &sigterm_watcher, sigterm_cb, NULL, SIGTERM);
+	uev_signal_init(ctx, &sigusr1_watcher, LOOP_CB(sigusr1_cb), NULL, SIGUSR1);
+	uev_signal_init(ctx, &sigusr2_watcher, LOOP_CB(sigusr2_cb), NULL, SIGUSR2);
+	uev_signal_init(ctx, &sigpwr_watcher,  LOOP_CB(sigpwr_cb),  NULL, SIGPWR);
+	uev_signal_init(ctx, &sigterm_watcher, LOOP_CB(sigterm_cb), NULL, SIGTERM);
 
 	/* Some C APIs may need SIGALRM for implementing timers. */
 	IGNSIG(sa, SIGALRM, 0);
 
 	/* /etc/inittab not supported yet, instead /etc/finit.d/ is scanned for *.conf */
-	uev_signal_init(ctx, &sighup_watcher, sighup_cb, NULL, SIGHUP);
+	uev_signal_init(ctx, &sighup_watcher, LOOP_CB(sighup_cb), NULL, SIGHUP);
 
 	/* After initial bootstrap of Finit we call the service monitor to reap children */
-	uev_signal_init(ctx, &sigchld_watcher, sigchld_cb, NULL, SIGCHLD);
+	uev_signal_init(ctx, &sigchld_watcher, LOOP_CB(sigchld_cb), NULL, SIGCHLD);
 
 	setsid();
 }
@@ -30,8 +30,10 @@
 #include "cond.h"
 #include "conf.h"
 #include "helpers.h"
+#include "metrics.h"
 #include "private.h"
 #include "service.h"
+#include "shutdown.h"
 #include "sig.h"
 #include "tty.h"
 #include "sm.h"
@@ -108,6 +110,11 @@ int sm_is_in_teardown(sm_t *sm)
 	return sm->in_teardown;
 }
 
+int sm_is_in_reload(sm_t *sm)
+{
+	return sm->state == SM_RELOAD_CHANGE_STATE || sm->state == SM_RELOAD_WAIT_STATE;
+}
+
 void sm_step(sm_t *sm)
 {
 	svc_t *svc;
@@ -152,6 +159,7 @@ restart:
 		if (runlevel == 0 || runlevel == 6) {
 			log_exit();
 			plugin_run_hooks(HOOK_SHUTDOWN);
+			shutdown_begin();
 		}
 
 		_d("Setting new runlevel --> %d <-- previous %d", runlevel, prevlevel);
@@ -184,12 +192,21 @@ restart:
 		/*
 		 * Need to wait for any services to stop? If so, exit early
 		 * and perform second stage from service_monitor later.
+		 * At shutdown, services are stopped one level at a time.
 		 */
 		svc = svc_stop_completed();
+		while (!svc && shutdown_next()) {
+			service_step_all(SVC_TYPE_ANY);
+			svc = svc_stop_completed();
+		}
 		if (svc) {
 			_d("Waiting to collect %s(%d) ...", svc->cmd, svc->pid);
 			break;
 		}
+		if (shutdown_busy()) {
+			_d("Waiting for SysV stop scripts ...");
+			break;
+		}
 
 		/* Prev runlevel services stopped, call hooks before starting new runlevel ... */
 		_d("All services have been stopped, calling runlevel change hooks ...");
@@ -209,6 +226,7 @@ restart:
 		 *  tears ... in ... rain."
 		 */
 		if (runlevel == 0 || runlevel == 6) {
+			shutdown_end();
 			do_shutdown(halt);
 			sm->state = SM_RUNNING_STATE;
 			break;
@@ -218,6 +236,8 @@ restart:
 		break;
 
 	case SM_RELOAD_CHANGE_STATE:
+		metrics_reload_begin();
+
 		/* First reload all *.conf in /etc/finit.d/ */
 		conf_reload();
 
@@ -241,6 +261,9 @@ restart:
 		svc = svc_stop_completed();
 		if (svc) {
 			_d("Waiting to collect %s(%d) ...", svc->cmd, svc->pid);
+			/* Start services no longer in conflict with those left */
+			if (runlevel != 0 && runlevel != 6)
+				service_step_all(SVC_TYPE_ANY);
 			break;
 		}
 
@@ -257,6 +280,7 @@ restart:
 
 		service_step_all(SVC_TYPE_ANY);
 		_d("Reconfiguration done");
+		metrics_reload_end();
 
 		sm->state = SM_RUNNING_STATE;
 		break;
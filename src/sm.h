@@ -47,6 +47,7 @@ void sm_step(sm_t *sm);
 void sm_set_runlevel(sm_t *sm, int newlevel);
 void sm_set_reload(sm_t *sm);
 int  sm_is_in_teardown(sm_t *sm);
+int  sm_is_in_reload(sm_t *sm);
 
 #endif	/* FINIT_SM_H_ */
 
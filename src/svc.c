@@ -24,6 +24,7 @@
 
 #include <err.h>
 #include <ctype.h>		/* isdigit() */
+#include <fnmatch.h>
 #include <time.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -38,6 +39,7 @@
 #include "finit.h"
 #include "svc.h"
 #include "helpers.h"
+#include "logbuf.h"
 #include "pid.h"
 #include "util.h"
 #include "cond.h"
@@ -95,6 +97,7 @@ static void svc_gc(void *arg)
 
 		TAILQ_REMOVE(&gc_list, svc, link);
 		maybe_clear_cond(svc);
+		logbuf_free(svc->logbuf);
 		free(svc);
 	}
 
@@ -149,6 +152,12 @@ svc_t *svc_new(char *cmd, char *id, int type)
 	/* Default delay between SIGTERM and SIGKILL */
 	svc->killdelay = SVC_TERM_TIMEOUT;
 
+	/* Start accounting time in SVC_HALTED_STATE */
+	svc->state_ts = mono_usec();
+
+	/* No condition state seen yet, see service_cond() */
+	svc->cond_last = svc->cond_raw = -1;
+
 	TAILQ_INSERT_TAIL(&svc_list, svc, link);
 
 	return svc;
@@ -703,6 +712,23 @@ int svc_parse_jobstr(char *str, size_t len, int (*found)(svc_t *), int (not_foun
 				else if (found)
 					result += found(svc);
 			}
+		} else if (strpbrk(token, "*?[")) {
+			int num = 0;
+
+			/* Glob matches name, or name:id when given */
+			for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+				char ident[MAX_IDENT_LEN];
+
+				if (fnmatch(token, ptr ? svc_ident(svc, ident, sizeof(ident)) : svc->name, 0))
+					continue;
+
+				num++;
+				if (found)
+					result += found(svc);
+			}
+
+			if (!num && not_found)
+				result += not_found(token, id);
 		} else {
 			if (!ptr) {
 				svc = svc_named_iterator(&iter, 1, token);
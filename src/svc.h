@@ -28,6 +28,7 @@
 #include <sys/ipc.h>		/* IPC_CREAT */
 #include <sys/resource.h>
 #include <sys/types.h>		/* pid_t */
+#include <stdint.h>
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
 # include <libite/queue.h>	/* BSD sys/queue.h API */
@@ -144,12 +145,38 @@ typedef struct svc {
 	char           respawn;	       /* ttys, or services with `respawn`, never increment restart_cnt */
 	const char     restart_cnt;    /* Incremented for each restart by service monitor. */
 
+	/* Metrics, see metrics.c */
+	unsigned int   start_cnt;      /* Number of times started */
+	unsigned int   crash_cnt;      /* Number of times collected unexpectedly */
+	uint64_t       state_ts;       /* mono_usec() when entering current state */
+	uint64_t       state_usec[SVC_RUNNING_STATE + 1];
+
+	/* Software watchdog, see keepalive.c */
+	int            wdog;           /* Keepalive interval in sec, 0: disabled */
+	int            wdog_cnt;       /* Restarts due to missed keepalive */
+	uint64_t       wdog_ping;      /* mono_usec() of last keepalive, 0: disarmed */
+	uev_t          wdog_timer;
+
+	/* Condition hysteresis, see service_cond() */
+	int            settle;         /* msec the conditions must be stable */
+	int            cond_last;      /* Aggregate state last acted on, -1: none */
+	int            cond_raw;       /* Aggregate state last seen */
+	uint64_t       cond_ts;        /* mono_usec() when cond_raw changed */
+
+	/* Shutdown order, see shutdown.c */
+	int            stop_level;     /* Stopped after all services depending on us */
+	uint64_t       stop_usec;      /* state_usec[SVC_STOPPING_STATE] at shutdown */
+
+	/* Last output from service, see logbuf.c */
+	struct logbuf *logbuf;
+
 	union {
 		/* services we redirect stdout/stderr to syslog (not TTYs!) */
 		struct {
 			char  enabled;
 			char  null;
 			char  console;
+			char  buffer;
 			char  file[64];
 			char  prio[20];
 			char  ident[20];
@@ -311,6 +311,16 @@ void do_usleep(unsigned int usec)
 		;
 }
 
+/* Monotonic time in microseconds, for measuring durations */
+uint64_t mono_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /* Seconds since boot, from sysinfo() */
 long jiffies(void)
 {
@@ -65,6 +65,7 @@ char *code2str     (int code);
 
 void  do_sleep     (unsigned int sec);
 void  do_usleep    (unsigned int usec);
+uint64_t mono_usec (void);
 long  jiffies      (void);
 char *uptime       (long secs, char *buf, size_t len);
 char *memsz        (uint64_t sz, char *buf, size_t len);
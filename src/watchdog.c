@@ -22,8 +22,11 @@
  */
 
 #include <config.h>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sysexits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -33,24 +36,82 @@
 #include <signal.h>
 #include <syslog.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <linux/watchdog.h>
 
 #include "watchdog.h"
 
 int running  = 1;
 int handover = 0;
-int shutdown = 0;
+int powerdown = 0;
 
 static void sighandler(int signo)
 {
 	if (signo == SIGTERM)
 		handover = 1;
 	if (signo == SIGPWR)
-		shutdown = 1;
+		powerdown = 1;
 
 	running = 0;
 }
 
+static time_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/*
+ * Socket PID 1 sends its event loop heartbeat to.  On failure we fall
+ * back to kicking the watchdog unconditionally, like before.
+ */
+static int heartbeat_init(void)
+{
+	struct sockaddr_un sun = {
+		.sun_family = AF_UNIX,
+		.sun_path   = WDT_HEARTBEAT,
+	};
+	int sd;
+
+	sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd == -1)
+		goto fail;
+
+	unlink(WDT_HEARTBEAT);
+	if (bind(sd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		close(sd);
+		goto fail;
+	}
+
+	return sd;
+fail:
+	syslog(LOG_WARNING, "Cannot receive heartbeat on %s: %s", WDT_HEARTBEAT, strerror(errno));
+	return -1;
+}
+
+/*
+ * Drain all pending heartbeats, each carries PID 1's current deadline.
+ * Returns the number of heartbeats read.
+ */
+static int heartbeat_read(int sd, int *deadline)
+{
+	char msg[16];
+	ssize_t len;
+	int num = 0;
+
+	while ((len = recv(sd, msg, sizeof(msg) - 1, 0)) >= 0) {
+		msg[len] = 0;
+		if (atoi(msg) > 0)
+			*deadline = atoi(msg);
+		num++;
+	}
+
+	return num;
+}
+
 static int init(char *progname, char *devnode)
 {
 	int fd;
@@ -69,20 +130,56 @@ static int init(char *progname, char *devnode)
 	return fd;
 }
 
+/*
+ * Kick the watchdog only as long as PID 1 is alive, i.e., its event
+ * loop sends heartbeats.  Before the first one we allow WDT_GRACE sec
+ * for bootstrap.  Once stopped, the watchdog resets the system.
+ */
 static int loop(int fd, int timeout)
 {
-	int dummy = 0;
+	int deadline = WDT_DEADLINE;
 	int period = timeout / 2;
+	time_t start, last = 0;
+	int dummy = 0;
+	int hung = 0;
+	int sd;
 
 	ioctl(fd, WDIOC_SETTIMEOUT, &timeout);
+	sd = heartbeat_init();
+	start = now();
 
 	while (running) {
-		ioctl(fd, WDIOC_KEEPALIVE, &dummy);
-		sleep(period);
+		struct pollfd pfd = { .fd = sd, .events = POLLIN };
+		time_t t = now();
+
+		if (sd != -1 && heartbeat_read(sd, &deadline)) {
+			if (hung)
+				syslog(LOG_NOTICE, "PID 1 heartbeat resumed, kicking %s again.", WDT_DEVNODE);
+			last = t;
+			hung = 0;
+		}
+
+		if (sd == -1 || (!last && t - start < WDT_GRACE) || (last && t - last < deadline)) {
+			ioctl(fd, WDIOC_KEEPALIVE, &dummy);
+		} else if (!hung) {
+			syslog(LOG_ALERT, "No heartbeat from PID 1 in %d sec, no longer kicking %s!",
+			       (int)(t - (last ? last : start)), WDT_DEVNODE);
+			hung = 1;
+		}
+
+		if (sd == -1)
+			sleep(period);
+		else
+			poll(&pfd, 1, period * 1000);
+	}
+
+	if (sd != -1) {
+		close(sd);
+		unlink(WDT_HEARTBEAT);
 	}
 
 	/* System is going down, prepare to reboot system on TERM */
-	if (shutdown) {
+	if (powerdown) {
 		timeout /= 3;
 		ioctl(fd, WDIOC_SETTIMEOUT, &timeout);
 	}
@@ -116,7 +213,7 @@ int main(int argc, char *argv[])
 		sleep(1);
 
 		/* Set lowest possible timeout on SIGPWR */
-		ioctl(fd, WDIOC_SETTIMEOUT, &shutdown);
+		ioctl(fd, WDIOC_SETTIMEOUT, &powerdown);
 	}
 	close(fd);
 done:
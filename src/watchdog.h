@@ -22,12 +22,23 @@
  */
 
 #include "config.h"		/* Generated by configure script */
+#include <paths.h>
 
 #ifndef WDT_DEVNODE
 #define WDT_DEVNODE "/dev/watchdog"
 #endif
 #define WDT_TIMEOUT 30
 
+/*
+ * Heartbeat from the PID 1 event loop.  Without one for WDT_DEADLINE
+ * sec the watchdog is no longer kicked and resets the system.  Until
+ * the first heartbeat, WDT_GRACE sec are allowed for bootstrap.
+ */
+#define WDT_HEARTBEAT      _PATH_VARRUN "finit/watchdog"
+#define WDT_HEARTBEAT_MSEC 1000
+#define WDT_DEADLINE       60
+#define WDT_GRACE          300
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
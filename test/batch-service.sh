@@ -0,0 +1,42 @@
+#!/bin/sh
+# Verifies that initctl batch runs commands read from stdin, and that a
+# failing line does not stop the rest of the batch.
+
+set -eu
+
+TEST_DIR=$(dirname "$0")
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/tenv/lib.sh"
+
+test_teardown() {
+    say "Test done $(date)"
+    say "Running test teardown."
+
+    texec rm -f "$FINIT_CONF"
+    texec rm -f /test_assets/service.sh
+}
+
+say "Test start $(date)"
+
+cp "$TEST_DIR"/common/service.sh "$TENV_ROOT"/test_assets/
+
+say "Add service stanza in $FINIT_CONF"
+texec sh -c "echo 'service [2345] kill:20 log /test_assets/service.sh -- Test service' > $FINIT_CONF"
+
+say 'Reload Finit'
+texec sh -c "initctl reload"
+
+retry 'assert_num_children 1 service.sh'
+
+say 'Stop the service in a batch'
+texec sh -c "printf '# comment\nquery service.sh\nstop service.sh\n' | initctl batch"
+
+retry 'assert_num_children 0 service.sh'
+
+say 'Start the service in a batch with a bad line'
+rc=0
+texec sh -c "printf 'start nosuch.sh\nstart service.sh\n' | initctl batch" || rc=$?
+
+assert "Batch reports the bad line" "$rc" -ne 0
+retry 'assert_num_children 1 service.sh'
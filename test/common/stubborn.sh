@@ -0,0 +1,8 @@
+#!/bin/sh
+# Ignores SIGTERM, so Finit has to wait kill:SEC before SIGKILL
+
+trap '' TERM
+
+while true; do
+  sleep 1
+done
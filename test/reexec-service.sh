@@ -0,0 +1,43 @@
+#!/bin/sh
+# Verifies that a running service keeps its PID and state when Finit
+# re-executes itself with initctl reexec.
+
+set -eu
+
+TEST_DIR=$(dirname "$0")
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/tenv/lib.sh"
+
+test_teardown() {
+    say "Test done $(date)"
+    say "Running test teardown."
+
+    texec rm -f "$FINIT_CONF"
+    texec rm -f /test_assets/service.sh
+}
+
+say "Test start $(date)"
+
+cp "$TEST_DIR"/common/service.sh "$TENV_ROOT"/test_assets/
+
+say "Add service stanza in $FINIT_CONF"
+texec sh -c "echo 'service [2345] kill:20 log /test_assets/service.sh -- Test service' > $FINIT_CONF"
+
+say 'Reload Finit'
+texec sh -c "initctl reload"
+
+retry 'assert_num_children 1 service.sh'
+retry 'assert_new_pid service.sh /run/service.pid'
+
+pid=$(texec cat /run/service.pid)
+
+say 'Re-execute Finit'
+texec sh -c "initctl reexec"
+
+retry 'texec initctl status service.sh >/dev/null'
+
+assert_num_children 1 service.sh
+assert "Service kept its PID" "$(texec cat /run/service.pid)" -eq "$pid"
+assert_new_pid service.sh /run/service.pid
+assert "Service is still running" "$(texec initctl status service.sh | grep -c 'Status.*running')" -eq 1
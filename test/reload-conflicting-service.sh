@@ -0,0 +1,47 @@
+#!/bin/sh
+# Verifies that on reload new services start while a removed service is
+# still stopping, unless they conflict with it, here same PID file.
+
+set -eu
+
+TEST_DIR=$(dirname "$0")
+
+# shellcheck source=/dev/null
+. "$TEST_DIR/tenv/lib.sh"
+
+test_teardown() {
+    say "Test done $(date)"
+    say "Running test teardown."
+
+    texec rm -f "$FINIT_CONF"
+    texec rm -f /test_assets/stubborn.sh /test_assets/free.sh /test_assets/blocked.sh
+}
+
+say "Test start $(date)"
+
+cp "$TEST_DIR"/common/stubborn.sh "$TENV_ROOT"/test_assets/
+cp "$TEST_DIR"/common/service.sh "$TENV_ROOT"/test_assets/free.sh
+cp "$TEST_DIR"/common/service.sh "$TENV_ROOT"/test_assets/blocked.sh
+
+say "Add a service that ignores SIGTERM in $FINIT_CONF"
+texec sh -c "echo 'service [2345] kill:10 pid:/run/conflict.pid /test_assets/stubborn.sh -- Stubborn' > $FINIT_CONF"
+
+say 'Reload Finit'
+texec sh -c "initctl reload"
+
+retry 'assert_num_children 1 stubborn.sh'
+
+say 'Replace it with an unrelated service, and one using the same PID file'
+texec sh -c "echo 'service [2345] /test_assets/free.sh -- Unrelated' > $FINIT_CONF"
+texec sh -c "echo 'service [2345] pid:/run/conflict.pid /test_assets/blocked.sh -- Conflicting' >> $FINIT_CONF"
+
+say 'Reload Finit'
+texec sh -c "initctl reload"
+
+retry 'assert_num_children 1 free.sh'
+assert_num_children 1 stubborn.sh
+assert_num_children 0 blocked.sh
+
+say 'Wait for the stubborn service to be killed'
+retry 'assert_num_children 0 stubborn.sh' 30 0.5
+retry 'assert_num_children 1 blocked.sh'